@@ -1,12 +1,28 @@
 #include "argumentParser.h"
+#include "trace.h"
+#include "peephole.h"
+#include "metrics.h"
+
+#include <fstream>
+#include <stdlib.h>
+#include <vector>
 
 extern bool DEBUG_FLAG;
+extern thread_local bool optimize;
+extern bool PEEPHOLE_REPORT;
+extern bool ASM_OUTPUT;
+extern bool RUN_IN_PROCESS;
+extern bool INTERPRET;
+extern bool USE_CACHE;
 void abort(std::string);
 extern int CURRENT_OS;
 extern int OS_WINDOWS;
 extern int OS_LINUX;
-extern std::string sourceFileName;
-extern std::string sourceFileBaseName;
+extern std::vector<std::string> sourceFiles;
+extern int JOBS;
+extern bool TIME_REPORT;
+extern bool METRICS_JSON;
+extern std::string metricsFile;
 
 bool isFlag(char *arg) {
   return arg[0] == '-';
@@ -22,6 +38,25 @@ void fixPath(std::string *path) {
   }
 }
 
+void addSourceFile(std::string name) {
+  fixPath(&name);
+  sourceFiles.push_back(name);
+}
+
+//@file names a manifest, a list of source files one per line
+void readManifest(std::string name) {
+  std::ifstream manifest(name.c_str());
+  if (!manifest)
+    abort("failed to open manifest \"" + name + "\"");
+  std::string line;
+  while (std::getline(manifest, line)) {
+    size_t first = line.find_first_not_of(" \t\r");
+    size_t last = line.find_last_not_of(" \t\r");
+    if (first != std::string::npos)
+      addSourceFile(line.substr(first, last - first + 1));
+  }
+}
+
 void parseArgs(int argCount, char* args[]) {
   bool hasSourceFile = false;
   if (argCount < 2) {
@@ -30,18 +65,72 @@ void parseArgs(int argCount, char* args[]) {
   for (int i = 1; i < argCount; i++) {
       if (isFlag(args[i])) {
         switch(args[i][1]) {
-        case 'd':
+        case 'd': // -d traces everything, -d1 to -d4 pick a trace level
           DEBUG_FLAG = true;
+          if (args[i][2] >= '0' && args[i][2] <= '9')
+            traceStart(args[i][2] - '0');
+          else
+            traceStart(TRACE_MAX_LEVEL);
+          break;
+        case 'O': // -O0 turns the IR and peephole optimizers off
+          optimize = args[i][2] != '0';
+          peepholeEnabled = optimize;
+          break;
+        case 'p': // -p reports how often each peephole rule fired
+          PEEPHOLE_REPORT = true;
+          break;
+        case 'S': // -S writes a .asm file and runs nasm on it
+          ASM_OUTPUT = true;
+          break;
+        case 'r': // -run runs the program in the compiler's process
+          if (std::string(args[i]) != "-run")
+            abort(std::string("unrecognized parameter: \"") + args[i] + "\"");
+          RUN_IN_PROCESS = true;
+          break;
+        case 'v': // -vm runs the program with the bytecode interpreter
+          if (std::string(args[i]) != "-vm")
+            abort(std::string("unrecognized parameter: \"") + args[i] + "\"");
+          INTERPRET = true;
+          break;
+        case 'n': // -nocache builds without the build cache
+          if (std::string(args[i]) != "-nocache")
+            abort(std::string("unrecognized parameter: \"") + args[i] + "\"");
+          USE_CACHE = false;
+          break;
+        case 'j': { // -jN or -j N builds N source files at a time
+          const char *jobs = args[i][2] != 0 ? args[i] + 2 : i + 1 < argCount ? args[++i] : "";
+          JOBS = atoi(jobs);
+          if (JOBS < 1)
+            abort(std::string("-j needs a number of jobs"));
+          break;
+        }
+        case 'f': // -ftime-report prints how long each phase took
+          if (std::string(args[i]) != "-ftime-report")
+            abort(std::string("unrecognized parameter: \"") + args[i] + "\"");
+          TIME_REPORT = METRICS = true;
+          break;
+        case '-': { // --metrics=json writes the metrics to stdout, --metrics=json:file to file
+          std::string arg = args[i];
+          if (arg.compare(0, 14, "--metrics=json") != 0 || (arg.size() > 14 && arg[14] != ':'))
+            abort("unrecognized parameter: \"" + arg + "\"");
+          if (arg.size() > 15)
+            metricsFile = arg.substr(15);
+          METRICS_JSON = METRICS = true;
+          break;
+        }
+        case 'P': // -Pname turns peephole rule name off
+          if (!disableRule(args[i] + 2))
+            abort(std::string("unknown peephole rule: \"") + (args[i] + 2) + "\"");
           break;
         default:
           std::stringstream ss;
           ss << "unrecognized parameter: \"" << args[i] << "\"";
           abort(ss.str());
         }
+      } else if (args[i][0] == '@') {
+        readManifest(args[i] + 1);
       } else {
-        sourceFileName = args[i];
-        fixPath(&sourceFileName);
-        sourceFileBaseName = sourceFileName.substr(0,sourceFileName.find_last_of('.'));
+        addSourceFile(args[i]);
       }
   }
 }
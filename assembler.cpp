@@ -0,0 +1,924 @@
+#include "assembler.h"
+#include "trace.h"
+
+#include <map>
+#include <stdlib.h>
+#include <ctype.h>
+
+using namespace std;
+
+void abort(string);
+
+thread_local vector<uint8_t> objectText;
+thread_local vector<uint8_t> objectData;
+thread_local uint64_t objectBssSize;
+thread_local vector<ObjectSymbol> objectSymbols;
+thread_local vector<Relocation> objectRelocations;
+
+const int OPERAND_REGISTER  = 0;
+const int OPERAND_MEMORY    = 1;
+const int OPERAND_IMMEDIATE = 2;
+
+struct Operand {
+  int kind;
+  int reg;          // register number 0 to 15
+  int size;         // in bytes, 0 if the operand doesn't say
+  int base;         // memory, -1 if none
+  int index;        // memory, -1 if none
+  int scale;
+  int64_t value;    // immediate or displacement
+  string symbol;    // whose address is added to value, empty if none
+};
+
+// a place in .text before the jumps are sized, the bytes written so far
+// and how many jumps come before them
+struct TextPlace {
+  size_t position;
+  size_t jumps;
+};
+
+struct Jump {
+  TextPlace place;
+  int condition;    // -1 for jmp
+  int target;       // symbol
+  bool wide;        // rel32 rather than rel8
+};
+
+struct PendingRelocation {
+  TextPlace place;
+  int symbol;
+  int type;
+  int64_t addend;
+};
+
+static thread_local vector<uint8_t> code;       // .text without its jumps
+static thread_local vector<Jump> jumps;
+static thread_local vector<PendingRelocation> pending;
+static thread_local vector<size_t> labelJumps;  // per symbol, jumps before a .text label
+static thread_local vector<char> isExtern;      // per symbol
+static thread_local map<string, int> symbolIndex;
+static thread_local int section = SECTION_TEXT;
+static thread_local string currentLine;         // for error messages
+
+static const char *registerNames[4][16] = {
+  {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+   "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+  {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+   "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+  {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+   "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+  {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+   "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"}
+};
+static const int registerSizes[4] = {1, 2, 4, 8};
+
+// condition codes in encoding order, the second column holds synonyms
+static const char *conditions[16][3] = {
+  {"o", "", ""},    {"no", "", ""},   {"b", "c", "nae"}, {"ae", "nc", "nb"},
+  {"e", "z", ""},   {"ne", "nz", ""}, {"be", "na", ""},  {"a", "nbe", ""},
+  {"s", "", ""},    {"ns", "", ""},   {"p", "pe", ""},   {"np", "po", ""},
+  {"l", "nge", ""}, {"ge", "nl", ""}, {"le", "ng", ""},  {"g", "nle", ""}
+};
+
+static void fail(string why) {
+  abort("cannot assemble \"" + currentLine + "\": " + why);
+}
+
+/////////////////////////////////////////////////////
+// symbols
+/////////////////////////////////////////////////////
+
+static int symbol(const string &name) {
+  map<string, int>::iterator s = symbolIndex.find(name);
+  if (s != symbolIndex.end())
+    return s->second;
+  ObjectSymbol o;
+  o.name = name;
+  o.section = SECTION_UNDEFINED;
+  o.value = 0;
+  o.global = false;
+  objectSymbols.push_back(o);
+  labelJumps.push_back(0);
+  isExtern.push_back(false);
+  symbolIndex[name] = objectSymbols.size() - 1;
+  return objectSymbols.size() - 1;
+}
+
+static void defineLabel(const string &name) {
+  int s = symbol(name);
+  if (objectSymbols[s].section != SECTION_UNDEFINED)
+    fail("label defined twice");
+  objectSymbols[s].section = section;
+  if (section == SECTION_TEXT) {
+    objectSymbols[s].value = code.size();
+    labelJumps[s] = jumps.size();
+  } else if (section == SECTION_DATA) {
+    objectSymbols[s].value = objectData.size();
+  } else {
+    objectSymbols[s].value = objectBssSize;
+  }
+}
+
+/////////////////////////////////////////////////////
+// operands
+/////////////////////////////////////////////////////
+
+static string trim(const string &s) {
+  size_t b = s.find_first_not_of(" \t");
+  if (b == string::npos)
+    return "";
+  return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+static string lower(string s) {
+  for (size_t i = 0; i < s.size(); i++)
+    s[i] = tolower(s[i]);
+  return s;
+}
+
+//register number of a name and its size, -1 if it isn't one
+static int registerOf(const string &name, int &size) {
+  string n = lower(name);
+  for (int s = 0; s < 4; s++)
+    for (int r = 0; r < 16; r++)
+      if (n == registerNames[s][r]) {
+        size = registerSizes[s];
+        return r;
+      }
+  return -1;
+}
+
+//decimal or 0x hex, wrapping to 64 bits like nasm
+static bool parseNumber(const string &s, int64_t &value) {
+  if (s.empty() || !isdigit((unsigned char)s[0]))
+    return false;
+  char *end;
+  if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    value = (int64_t)strtoull(s.c_str() + 2, &end, 16);
+  else
+    value = (int64_t)strtoull(s.c_str(), &end, 10);
+  return *end == '\0';
+}
+
+//add up terms joined by + and -, registers go to base and index when
+//inside brackets
+static void parseTerms(const string &text, Operand &o, bool memory) {
+  size_t i = 0;
+  while (i < text.size()) {
+    int sign = 1;
+    while (i < text.size() && (text[i] == '+' || text[i] == '-' || text[i] == ' ')) {
+      if (text[i] == '-')
+        sign = -sign;
+      i++;
+    }
+    size_t start = i;
+    while (i < text.size() && text[i] != '+' && text[i] != '-')
+      i++;
+    string term = trim(text.substr(start, i - start));
+    if (term.empty())
+      fail("missing term");
+    int64_t n;
+    int size;
+    size_t star = term.find('*');
+    if (parseNumber(term, n)) {
+      o.value += sign * n;
+    } else if (memory && star != string::npos) {
+      int64_t scale;
+      if (!parseNumber(trim(term.substr(star + 1)), scale) || o.index >= 0)
+        fail("bad index");
+      o.index = registerOf(trim(term.substr(0, star)), size);
+      o.scale = scale;
+    } else if (memory && registerOf(term, size) >= 0) {
+      if (sign < 0 || size != 8)
+        fail("bad address register");
+      if (o.base < 0)
+        o.base = registerOf(term, size);
+      else if (o.index < 0)
+        o.index = registerOf(term, size);
+      else
+        fail("too many registers");
+    } else {
+      if (sign < 0 || !o.symbol.empty())
+        fail("one symbol per operand");
+      o.symbol = term;
+    }
+  }
+  if (o.index >= 0 && (o.index == 4 || (o.scale != 1 && o.scale != 2 && o.scale != 4 && o.scale != 8)))
+    fail("bad index");
+}
+
+static Operand parseOperand(string arg) {
+  Operand o;
+  o.kind = OPERAND_IMMEDIATE;
+  o.reg = -1;
+  o.size = 0;
+  o.base = -1;
+  o.index = -1;
+  o.scale = 1;
+  o.value = 0;
+  static const char *sizeNames[4] = {"byte", "word", "dword", "qword"};
+  string l = lower(arg);
+  for (int s = 0; s < 4; s++) {
+    string name = sizeNames[s];
+    if (l.compare(0, name.size(), name) == 0 && l.size() > name.size() &&
+        (l[name.size()] == ' ' || l[name.size()] == '\t' || l[name.size()] == '[')) {
+      o.size = registerSizes[s];
+      arg = trim(arg.substr(name.size()));
+      break;
+    }
+  }
+  if (!arg.empty() && arg[0] == '[') {
+    if (arg[arg.size() - 1] != ']')
+      fail("unclosed bracket");
+    o.kind = OPERAND_MEMORY;
+    parseTerms(arg.substr(1, arg.size() - 2), o, true);
+    return o;
+  }
+  int size;
+  o.reg = registerOf(arg, size);
+  if (o.reg >= 0) {
+    o.kind = OPERAND_REGISTER;
+    o.size = size;
+    return o;
+  }
+  parseTerms(arg, o, false);
+  return o;
+}
+
+/////////////////////////////////////////////////////
+// encoding
+/////////////////////////////////////////////////////
+
+static void byte(int64_t b) {
+  code.push_back((uint8_t)b);
+}
+
+static void word16(int64_t v) {
+  byte(v);
+  byte(v >> 8);
+}
+
+static void word32(int64_t v) {
+  for (int i = 0; i < 4; i++)
+    byte(v >> (8 * i));
+}
+
+static void word64(int64_t v) {
+  for (int i = 0; i < 8; i++)
+    byte(v >> (8 * i));
+}
+
+static void immediate(int64_t v, int bytes) {
+  if (bytes == 1)
+    byte(v);
+  else if (bytes == 2)
+    word16(v);
+  else if (bytes == 4)
+    word32(v);
+  else
+    word64(v);
+}
+
+static bool fitsByte(int64_t v) {
+  return v >= -128 && v <= 127;
+}
+
+static bool fitsInt32(int64_t v) {
+  return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static TextPlace here() {
+  TextPlace p;
+  p.position = code.size();
+  p.jumps = jumps.size();
+  return p;
+}
+
+//the next 4 bytes of .text need the address of a symbol
+static void relocate(const string &name, int type, int64_t addend) {
+  PendingRelocation r;
+  r.place = here();
+  r.symbol = symbol(name);
+  r.type = type;
+  r.addend = addend;
+  pending.push_back(r);
+}
+
+//true if a byte register can only be named with a REX prefix
+static bool needsRex(int reg, int size) {
+  return size == 1 && reg >= 4 && reg < 8;
+}
+
+//prefixes, REX, opcode, ModRM, SIB and displacement of an instruction
+//with a register or opcode extension reg and a register or memory rm.
+//Opcodes above 0xFF are two bytes. following is the immediate size, a rip
+//relative displacement counts from the end of the instruction
+static void encode(int size, int opcode, int reg, int regSize, const Operand &rm, int following) {
+  if (size == 2)
+    byte(0x66);
+  int rex = size == 8 ? 8 : 0;
+  bool rexNeeded = needsRex(reg, regSize);
+  if (reg & 8)
+    rex |= 4;
+  if (rm.kind == OPERAND_REGISTER) {
+    if (rm.reg & 8)
+      rex |= 1;
+    rexNeeded = rexNeeded || needsRex(rm.reg, rm.size);
+  } else {
+    if (rm.index >= 0 && (rm.index & 8))
+      rex |= 2;
+    if (rm.base >= 0 && (rm.base & 8))
+      rex |= 1;
+  }
+  if (rex != 0 || rexNeeded)
+    byte(0x40 | rex);
+  if (opcode > 0xFF)
+    byte(opcode >> 8);
+  byte(opcode & 0xFF);
+
+  int r = (reg & 7) << 3;
+  if (rm.kind == OPERAND_REGISTER) {
+    byte(0xC0 | r | (rm.reg & 7));
+    return;
+  }
+  bool hasSymbol = !rm.symbol.empty();
+  if (rm.base < 0 && rm.index < 0) {
+    if (hasSymbol) {
+      byte(0x05 | r);
+      relocate(rm.symbol, RELOC_PC32, rm.value - 4 - following);
+      word32(0);
+    } else {
+      byte(0x04 | r);
+      byte(0x25);
+      word32(rm.value);
+    }
+    return;
+  }
+  int scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+  if (rm.base < 0) {  // index and displacement only
+    byte(0x04 | r);
+    byte((scale << 6) | ((rm.index & 7) << 3) | 5);
+    if (hasSymbol)
+      relocate(rm.symbol, RELOC_ABS32S, rm.value);
+    word32(rm.value);
+    return;
+  }
+  int mod = 2;
+  if (!hasSymbol && rm.value == 0 && (rm.base & 7) != 5)
+    mod = 0;
+  else if (!hasSymbol && fitsByte(rm.value))
+    mod = 1;
+  if (rm.index >= 0 || (rm.base & 7) == 4) {
+    byte((mod << 6) | r | 4);
+    int index = rm.index >= 0 ? rm.index : 4;  // 4 is no index
+    byte((scale << 6) | ((index & 7) << 3) | (rm.base & 7));
+  } else {
+    byte((mod << 6) | r | (rm.base & 7));
+  }
+  if (mod == 1) {
+    byte(rm.value);
+  } else if (mod == 2) {
+    if (hasSymbol)
+      relocate(rm.symbol, RELOC_ABS32S, rm.value);
+    word32(rm.value);
+  }
+}
+
+//register number with the REX.B bit written, for opcodes that hold the
+//register in their low bits
+static void encodeShort(int size, int opcode, const Operand &reg) {
+  if (size == 2)
+    byte(0x66);
+  int rex = (size == 8 ? 8 : 0) | (reg.reg & 8 ? 1 : 0);
+  if (rex != 0 || needsRex(reg.reg, reg.size))
+    byte(0x40 | rex);
+  byte(opcode | (reg.reg & 7));
+}
+
+static int conditionCode(const string &cc) {
+  for (int c = 0; c < 16; c++)
+    for (int s = 0; s < 3; s++)
+      if (cc == conditions[c][s] && conditions[c][s][0] != '\0')
+        return c;
+  return -1;
+}
+
+//operand size of an instruction, from its registers or a size keyword
+static int operandSize(const vector<Operand> &args) {
+  int size = 0;
+  for (size_t a = 0; a < args.size(); a++) {
+    if (args[a].kind == OPERAND_IMMEDIATE || args[a].size == 0)
+      continue;
+    if (size != 0 && size != args[a].size)
+      fail("operand sizes differ");
+    size = args[a].size;
+  }
+  if (size == 0)
+    fail("operand size not specified");
+  return size;
+}
+
+static bool isImmediate(const Operand &o) {
+  return o.kind == OPERAND_IMMEDIATE && o.symbol.empty();
+}
+
+static void expect(bool ok) {
+  if (!ok)
+    fail("unsupported operands");
+}
+
+//add, or, and, sub, xor and cmp share their encodings, digit picks one
+static void arithmetic(int digit, const vector<Operand> &args) {
+  expect(args.size() == 2);
+  const Operand &dst = args[0];
+  const Operand &src = args[1];
+  if (isImmediate(src)) {
+    expect(dst.kind != OPERAND_IMMEDIATE);
+    int size = operandSize(args);
+    if (size == 1) {
+      encode(size, 0x80, digit, 0, dst, 1);
+      byte(src.value);
+    } else if (fitsByte(src.value)) {
+      encode(size, 0x83, digit, 0, dst, 1);
+      byte(src.value);
+    } else {
+      if (!fitsInt32(src.value))
+        fail("immediate out of range");
+      encode(size, 0x81, digit, 0, dst, size == 2 ? 2 : 4);
+      immediate(src.value, size == 2 ? 2 : 4);
+    }
+    return;
+  }
+  int size = operandSize(args);
+  int base = (digit << 3) | (size == 1 ? 0 : 1);
+  if (src.kind == OPERAND_REGISTER)
+    encode(size, base, src.reg, src.size, dst, 0);
+  else if (dst.kind == OPERAND_REGISTER && src.kind == OPERAND_MEMORY)
+    encode(size, base | 2, dst.reg, dst.size, src, 0);
+  else
+    expect(false);
+}
+
+static void move(const vector<Operand> &args) {
+  expect(args.size() == 2);
+  const Operand &dst = args[0];
+  const Operand &src = args[1];
+  if (src.kind == OPERAND_IMMEDIATE) {
+    int size = operandSize(args);
+    if (dst.kind == OPERAND_REGISTER) {
+      if (!src.symbol.empty()) {  // address of a symbol, zero extended
+        expect(size >= 4);
+        encodeShort(4, 0xB8, dst);
+        relocate(src.symbol, RELOC_ABS32, src.value);
+        word32(0);
+      } else if (size == 8 && src.value >= 0 && src.value <= UINT32_MAX) {
+        encodeShort(4, 0xB8, dst);
+        word32(src.value);
+      } else if (size == 8 && fitsInt32(src.value)) {
+        encode(8, 0xC7, 0, 0, dst, 4);
+        word32(src.value);
+      } else {
+        encodeShort(size, size == 1 ? 0xB0 : 0xB8, dst);
+        immediate(src.value, size);
+      }
+      return;
+    }
+    expect(src.symbol.empty() && (size == 1 || fitsInt32(src.value)));
+    int bytes = size == 8 ? 4 : size;
+    encode(size, size == 1 ? 0xC6 : 0xC7, 0, 0, dst, bytes);
+    immediate(src.value, bytes);
+    return;
+  }
+  int size = operandSize(args);
+  if (src.kind == OPERAND_REGISTER)
+    encode(size, size == 1 ? 0x88 : 0x89, src.reg, src.size, dst, 0);
+  else if (dst.kind == OPERAND_REGISTER && src.kind == OPERAND_MEMORY)
+    encode(size, size == 1 ? 0x8A : 0x8B, dst.reg, dst.size, src, 0);
+  else
+    expect(false);
+}
+
+//instructions with one register or memory operand and an opcode extension
+static void unary(int opcode, int digit, const vector<Operand> &args) {
+  expect(args.size() == 1 && args[0].kind != OPERAND_IMMEDIATE);
+  int size = operandSize(args);
+  encode(size, size == 1 ? opcode - 1 : opcode, digit, 0, args[0], 0);
+}
+
+static void shift(int digit, const vector<Operand> &args) {
+  expect(args.size() == 2 && args[0].kind != OPERAND_IMMEDIATE);
+  int size = args[0].size;
+  if (size == 0)
+    fail("operand size not specified");
+  if (isImmediate(args[1])) {
+    encode(size, size == 1 ? 0xC0 : 0xC1, digit, 0, args[0], 1);
+    byte(args[1].value);
+  } else {
+    expect(args[1].kind == OPERAND_REGISTER && args[1].reg == 1 && args[1].size == 1);
+    encode(size, size == 1 ? 0xD2 : 0xD3, digit, 0, args[0], 0);
+  }
+}
+
+static void jump(int condition, const vector<Operand> &args) {
+  expect(args.size() == 1 && args[0].kind == OPERAND_IMMEDIATE && !args[0].symbol.empty());
+  Jump j;
+  j.place = here();
+  j.condition = condition;
+  j.target = symbol(args[0].symbol);
+  j.wide = false;
+  jumps.push_back(j);
+}
+
+static void instruction(const string &op, const vector<Operand> &args) {
+  static const char *arithmeticOps[] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+  for (int d = 0; d < 8; d++)
+    if (op == arithmeticOps[d]) {
+      arithmetic(d, args);
+      return;
+    }
+  if (op == "mov") {
+    move(args);
+  } else if (op == "jmp") {
+    jump(-1, args);
+  } else if (op[0] == 'j' && conditionCode(op.substr(1)) >= 0) {
+    jump(conditionCode(op.substr(1)), args);
+  } else if (op.compare(0, 3, "set") == 0 && conditionCode(op.substr(3)) >= 0) {
+    expect(args.size() == 1 && args[0].kind != OPERAND_IMMEDIATE);
+    encode(1, 0x0F90 + conditionCode(op.substr(3)), 0, 0, args[0], 0);
+  } else if (op.compare(0, 4, "cmov") == 0 && conditionCode(op.substr(4)) >= 0) {
+    expect(args.size() == 2 && args[0].kind == OPERAND_REGISTER && args[1].kind != OPERAND_IMMEDIATE);
+    encode(operandSize(args), 0x0F40 + conditionCode(op.substr(4)), args[0].reg, args[0].size, args[1], 0);
+  } else if (op == "test") {
+    expect(args.size() == 2 && args[0].kind != OPERAND_IMMEDIATE);
+    int size = operandSize(args);
+    if (isImmediate(args[1])) {
+      int bytes = size == 8 ? 4 : size;
+      encode(size, size == 1 ? 0xF6 : 0xF7, 0, 0, args[0], bytes);
+      immediate(args[1].value, bytes);
+    } else {
+      expect(args[1].kind == OPERAND_REGISTER);
+      encode(size, size == 1 ? 0x84 : 0x85, args[1].reg, args[1].size, args[0], 0);
+    }
+  } else if (op == "movzx" || op == "movsx") {
+    expect(args.size() == 2 && args[0].kind == OPERAND_REGISTER && args[1].kind != OPERAND_IMMEDIATE);
+    int from = args[1].size;
+    expect(from == 1 || from == 2);
+    int opcode = (op == "movzx" ? 0x0FB6 : 0x0FBE) + (from == 2 ? 1 : 0);
+    encode(args[0].size, opcode, args[0].reg, args[0].size, args[1], 0);
+  } else if (op == "movsxd") {
+    expect(args.size() == 2 && args[0].kind == OPERAND_REGISTER && args[0].size == 8 &&
+           args[1].kind != OPERAND_IMMEDIATE);
+    encode(8, 0x63, args[0].reg, 8, args[1], 0);
+  } else if (op == "lea") {
+    expect(args.size() == 2 && args[0].kind == OPERAND_REGISTER && args[1].kind == OPERAND_MEMORY);
+    encode(args[0].size, 0x8D, args[0].reg, args[0].size, args[1], 0);
+  } else if (op == "imul" && args.size() == 1) {
+    unary(0xF7, 5, args);
+  } else if (op == "imul") {
+    // imul reg, imm is short for imul reg, reg, imm
+    vector<Operand> full(args);
+    if (full.size() == 2 && full[1].kind == OPERAND_IMMEDIATE)
+      full.insert(full.begin() + 1, full[0]);
+    expect(full[0].kind == OPERAND_REGISTER && full[1].kind != OPERAND_IMMEDIATE);
+    int size = full[0].size;
+    if (full.size() == 2) {
+      encode(size, 0x0FAF, full[0].reg, size, full[1], 0);
+    } else {
+      expect(full.size() == 3 && isImmediate(full[2]));
+      if (fitsByte(full[2].value)) {
+        encode(size, 0x6B, full[0].reg, size, full[1], 1);
+        byte(full[2].value);
+      } else {
+        if (!fitsInt32(full[2].value))
+          fail("immediate out of range");
+        encode(size, 0x69, full[0].reg, size, full[1], 4);
+        word32(full[2].value);
+      }
+    }
+  } else if (op == "bsf" || op == "bsr") {
+    expect(args.size() == 2 && args[0].kind == OPERAND_REGISTER && args[1].kind != OPERAND_IMMEDIATE);
+    encode(operandSize(args), op == "bsf" ? 0x0FBC : 0x0FBD, args[0].reg, args[0].size, args[1], 0);
+  } else if (op == "not") {
+    unary(0xF7, 2, args);
+  } else if (op == "neg") {
+    unary(0xF7, 3, args);
+  } else if (op == "mul") {
+    unary(0xF7, 4, args);
+  } else if (op == "div") {
+    unary(0xF7, 6, args);
+  } else if (op == "idiv") {
+    unary(0xF7, 7, args);
+  } else if (op == "inc") {
+    unary(0xFF, 0, args);
+  } else if (op == "dec") {
+    unary(0xFF, 1, args);
+  } else if (op == "shl" || op == "sal") {
+    shift(4, args);
+  } else if (op == "shr") {
+    shift(5, args);
+  } else if (op == "sar") {
+    shift(7, args);
+  } else if (op == "push") {
+    expect(args.size() == 1);
+    const Operand &a = args[0];
+    if (a.kind == OPERAND_REGISTER) {
+      expect(a.size == 8);
+      encodeShort(4, 0x50, a);
+    } else if (isImmediate(a) && fitsByte(a.value)) {
+      byte(0x6A);
+      byte(a.value);
+    } else if (isImmediate(a)) {
+      expect(fitsInt32(a.value));
+      byte(0x68);
+      word32(a.value);
+    } else {
+      expect(a.kind == OPERAND_MEMORY);
+      encode(4, 0xFF, 6, 0, a, 0);  // 64 bit by default
+    }
+  } else if (op == "pop") {
+    expect(args.size() == 1 && args[0].kind != OPERAND_IMMEDIATE);
+    if (args[0].kind == OPERAND_REGISTER) {
+      expect(args[0].size == 8);
+      encodeShort(4, 0x58, args[0]);
+    } else {
+      encode(4, 0x8F, 0, 0, args[0], 0);
+    }
+  } else if (op == "call") {
+    expect(args.size() == 1 && args[0].kind == OPERAND_IMMEDIATE && !args[0].symbol.empty());
+    byte(0xE8);
+    relocate(args[0].symbol, RELOC_PLT32, args[0].value - 4);
+    word32(0);
+  } else if (op == "ret" && args.empty()) {
+    byte(0xC3);
+  } else if (op == "syscall" && args.empty()) {
+    byte(0x0F);
+    byte(0x05);
+  } else if (op == "cqo" && args.empty()) {
+    byte(0x48);
+    byte(0x99);
+  } else if (op == "rep" && args.size() == 1 && args[0].symbol == "movsb") {
+    byte(0xF3);
+    byte(0xA4);
+  } else {
+    fail("unknown instruction");
+  }
+}
+
+/////////////////////////////////////////////////////
+// lines
+/////////////////////////////////////////////////////
+
+//operands split at commas outside of brackets and quotes
+static vector<string> splitOperands(const string &s) {
+  vector<string> args;
+  int depth = 0;
+  char quote = 0;
+  string arg;
+  for (size_t i = 0; i <= s.size(); i++) {
+    char c = i < s.size() ? s[i] : ',';
+    if (quote != 0) {
+      if (c == quote)
+        quote = 0;
+    } else if (c == '"' || c == '\'') {
+      quote = c;
+    } else if (c == '[') {
+      depth++;
+    } else if (c == ']') {
+      depth--;
+    } else if (c == ',' && depth == 0) {
+      args.push_back(trim(arg));
+      arg.clear();
+      continue;
+    }
+    arg += c;
+  }
+  return args;
+}
+
+static const char *defines[] = {"db", "dw", "dd", "dq"};
+static const char *reserves[] = {"resb", "resw", "resd", "resq"};
+
+static bool isDirective(const string &op) {
+  for (int k = 0; k < 4; k++)
+    if (op == defines[k] || op == reserves[k])
+      return true;
+  return false;
+}
+
+//data definitions and reservations, the unit doubles with each column
+static void data(const string &directive, const string &operands) {
+  for (int k = 0; k < 4; k++) {
+    int unit = 1 << k;
+    if (directive == reserves[k]) {
+      Operand count = parseOperand(operands);
+      if (count.kind != OPERAND_IMMEDIATE || !count.symbol.empty() || count.value < 0)
+        fail("bad size");
+      if (section == SECTION_BSS)
+        objectBssSize += count.value * unit;
+      else if (section == SECTION_DATA)
+        objectData.insert(objectData.end(), count.value * unit, 0);
+      else
+        fail("space reserved in .text");
+      return;
+    }
+    if (directive == defines[k]) {
+      if (section != SECTION_DATA)
+        fail("data outside of .data");
+      vector<string> values = splitOperands(operands);
+      for (size_t v = 0; v < values.size(); v++) {
+        const string &value = values[v];
+        if (unit == 1 && value.size() >= 2 && (value[0] == '"' || value[0] == '\'')) {
+          objectData.insert(objectData.end(), value.begin() + 1, value.end() - 1);
+          continue;
+        }
+        Operand o = parseOperand(value);
+        if (!isImmediate(o))
+          fail("data must be a number");
+        for (int b = 0; b < unit; b++)
+          objectData.push_back((uint8_t)(o.value >> (8 * b)));
+      }
+      return;
+    }
+  }
+  fail("unknown directive");
+}
+
+void assembleLine(const string &line) {
+  currentLine = trim(line);
+  // drop the comment, a ; inside quotes belongs to a string
+  char quote = 0;
+  size_t end = line.size();
+  for (size_t i = 0; i < line.size() && end == line.size(); i++) {
+    if (quote != 0) {
+      if (line[i] == quote)
+        quote = 0;
+    } else if (line[i] == '"' || line[i] == '\'') {
+      quote = line[i];
+    } else if (line[i] == ';') {
+      end = i;
+    }
+  }
+  string s = trim(line.substr(0, end));
+  if (s.empty())
+    return;
+  size_t space = s.find_first_of(" \t");
+  string first = s.substr(0, space);
+  string rest = space == string::npos ? "" : trim(s.substr(space));
+  if (first[first.size() - 1] == ':') {
+    defineLabel(first.substr(0, first.size() - 1));
+    if (rest.empty())
+      return;
+    space = rest.find_first_of(" \t");
+    first = rest.substr(0, space);
+    rest = space == string::npos ? "" : trim(rest.substr(space));
+  }
+  string op = lower(first);
+  if (op == "section") {
+    if (rest == ".text")
+      section = SECTION_TEXT;
+    else if (rest == ".data")
+      section = SECTION_DATA;
+    else if (rest == ".bss")
+      section = SECTION_BSS;
+    else
+      fail("unknown section");
+  } else if (op == "global") {
+    objectSymbols[symbol(rest)].global = true;
+  } else if (op == "extern") {
+    int e = symbol(rest);
+    objectSymbols[e].global = true;
+    isExtern[e] = true;
+  } else if (isDirective(op)) {
+    data(op, rest);
+  } else {
+    if (section != SECTION_TEXT)
+      fail("instruction outside of .text");
+    vector<string> texts = splitOperands(rest);
+    vector<Operand> args;
+    if (!rest.empty())
+      for (size_t a = 0; a < texts.size(); a++)
+        args.push_back(parseOperand(texts[a]));
+    instruction(op, args);
+  }
+}
+
+/////////////////////////////////////////////////////
+// layout
+/////////////////////////////////////////////////////
+
+static int jumpSize(const Jump &j) {
+  if (!j.wide)
+    return 2;
+  return j.condition < 0 ? 5 : 6;
+}
+
+//widen the jumps whose target is out of reach of a byte until all fit,
+//jumps only ever grow so this settles
+static vector<size_t> placeJumps() {
+  vector<size_t> before(jumps.size() + 1, 0);  // bytes of jumps before each
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t k = 0; k < jumps.size(); k++)
+      before[k + 1] = before[k] + jumpSize(jumps[k]);
+    for (size_t k = 0; k < jumps.size(); k++) {
+      Jump &j = jumps[k];
+      if (j.wide)
+        continue;
+      const ObjectSymbol &target = objectSymbols[j.target];
+      int64_t end = j.place.position + before[k] + 2;
+      int64_t to = target.value + before[labelJumps[j.target]];
+      if (!fitsByte(to - end)) {
+        j.wide = true;
+        changed = true;
+      }
+    }
+  }
+  return before;
+}
+
+void finishAssembly() {
+  for (size_t s = 0; s < objectSymbols.size(); s++) {
+    const ObjectSymbol &o = objectSymbols[s];
+    if (o.section == SECTION_UNDEFINED && !isExtern[s])
+      abort("undefined label \"" + o.name + "\"");
+  }
+  for (size_t k = 0; k < jumps.size(); k++) {
+    if (objectSymbols[jumps[k].target].section != SECTION_TEXT) {
+      currentLine = "jump to " + objectSymbols[jumps[k].target].name;
+      fail("target is not in .text");
+    }
+  }
+  vector<size_t> before = placeJumps();
+  for (size_t s = 0; s < objectSymbols.size(); s++)
+    if (objectSymbols[s].section == SECTION_TEXT)
+      objectSymbols[s].value += before[labelJumps[s]];
+
+  // interleave the code with the jumps
+  objectText.clear();
+  objectText.reserve(code.size() + before[jumps.size()]);
+  size_t copied = 0;
+  for (size_t k = 0; k < jumps.size(); k++) {
+    const Jump &j = jumps[k];
+    objectText.insert(objectText.end(), code.begin() + copied, code.begin() + j.place.position);
+    copied = j.place.position;
+    int64_t end = objectText.size() + jumpSize(j);
+    int64_t rel = objectSymbols[j.target].value - end;
+    if (!j.wide) {
+      objectText.push_back(j.condition < 0 ? 0xEB : 0x70 + j.condition);
+      objectText.push_back((uint8_t)rel);
+      continue;
+    }
+    if (j.condition < 0) {
+      objectText.push_back(0xE9);
+    } else {
+      objectText.push_back(0x0F);
+      objectText.push_back(0x80 + j.condition);
+    }
+    for (int b = 0; b < 4; b++)
+      objectText.push_back((uint8_t)(rel >> (8 * b)));
+  }
+  objectText.insert(objectText.end(), code.begin() + copied, code.end());
+
+  // references within .text are known now, the rest is left to the linker
+  objectRelocations.clear();
+  for (size_t r = 0; r < pending.size(); r++) {
+    const PendingRelocation &p = pending[r];
+    uint64_t offset = p.place.position + before[p.place.jumps];
+    const ObjectSymbol &target = objectSymbols[p.symbol];
+    if (target.section == SECTION_TEXT && (p.type == RELOC_PC32 || p.type == RELOC_PLT32)) {
+      int64_t rel = target.value + p.addend - offset;
+      for (int b = 0; b < 4; b++)
+        objectText[offset + b] = (uint8_t)(rel >> (8 * b));
+      continue;
+    }
+    Relocation o;
+    o.offset = offset;
+    o.symbol = p.symbol;
+    o.type = p.type;
+    o.addend = p.addend;
+    objectRelocations.push_back(o);
+  }
+  TRACE(TRACE_LEVEL_PHASE, "finishAssembly() %d bytes of code, %d relocations",
+        (int64_t)objectText.size(), (int64_t)objectRelocations.size());
+}
+
+vector<uint8_t> relocatedText(const uint64_t sectionAddress[3]) {
+  vector<uint8_t> text(objectText);
+  for (size_t r = 0; r < objectRelocations.size(); r++) {
+    const Relocation &o = objectRelocations[r];
+    const ObjectSymbol &symbol = objectSymbols[o.symbol];
+    if (symbol.section == SECTION_UNDEFINED)
+      abort("undefined symbol \"" + symbol.name + "\"");
+    int64_t value = sectionAddress[symbol.section] + symbol.value + o.addend;
+    if (o.type == RELOC_PC32 || o.type == RELOC_PLT32)
+      value -= sectionAddress[SECTION_TEXT] + o.offset;
+    bool fits = o.type == RELOC_ABS32 ? value >= 0 && value <= (int64_t)UINT32_MAX
+                                      : value >= INT32_MIN && value <= INT32_MAX;
+    if (!fits)
+      abort("relocation against \"" + symbol.name + "\" out of range");
+    for (int b = 0; b < 4; b++)
+      text[o.offset + b] = (uint8_t)(value >> (8 * b));
+  }
+  return text;
+}
@@ -0,0 +1,64 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// in-process assembly of the emitted nasm text into x86-64 machine code
+//
+// the lines the peephole optimizer lets through are turned into the bytes
+// of .text and .data, the size of .bss, a symbol table and the relocations
+// still to be applied by whoever places the sections in memory. Only the
+// instructions and operand forms the backends and the peephole rules
+// produce are understood. Jumps are relaxed, they take their 2 byte form
+// whenever the target is close enough.
+//
+// memory operands naming just a symbol are rip relative, a symbol plus a
+// register is a 32 bit absolute address, as is moving a symbol's address
+// into a register. The program has to be placed in the low 2GB
+
+const int SECTION_UNDEFINED = -1;  // external, defined by the linker
+const int SECTION_TEXT = 0;
+const int SECTION_DATA = 1;
+const int SECTION_BSS  = 2;
+
+// relocation types, numbered like their ELF x86-64 counterparts
+const int RELOC_PC32   = 2;   // rip relative reference
+const int RELOC_PLT32  = 4;   // call of an external function
+const int RELOC_ABS32  = 10;  // 32 bit address, zero extended
+const int RELOC_ABS32S = 11;  // 32 bit address, sign extended
+
+struct ObjectSymbol {
+  std::string name;
+  int section;     // SECTION_*
+  uint64_t value;  // offset in the section
+  bool global;
+};
+
+// a field in .text that needs the address of a symbol
+struct Relocation {
+  uint64_t offset;
+  int symbol;      // index in objectSymbols
+  int type;        // RELOC_*
+  int64_t addend;
+};
+
+extern thread_local std::vector<uint8_t> objectText;
+extern thread_local std::vector<uint8_t> objectData;
+extern thread_local uint64_t objectBssSize;
+extern thread_local std::vector<ObjectSymbol> objectSymbols;
+extern thread_local std::vector<Relocation> objectRelocations;
+
+//assemble one line of nasm text, without its newline
+void assembleLine(const std::string &line);
+
+//place the jumps and resolve the references within .text, after this the
+//object tables above are complete
+void finishAssembly();
+
+//a copy of .text with every relocation applied, for sections placed at the
+//given addresses (indexed by SECTION_*)
+std::vector<uint8_t> relocatedText(const uint64_t sectionAddress[3]);
+
+#endif // ASSEMBLER_H
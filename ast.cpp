@@ -0,0 +1,94 @@
+#include "ast.h"
+#include "fold.h"
+
+#include <vector>
+
+using namespace std;
+
+extern thread_local uint64_t lineCount;
+
+static thread_local vector<Node> arena(1);
+thread_local Node *nodes = &arena[0];
+
+int newNode(int kind) {
+  Node n = Node();
+  n.kind = kind;
+  n.line = lineCount > UINT32_MAX ? UINT32_MAX : lineCount;
+  arena.push_back(n);
+  nodes = &arena[0];
+  return arena.size() - 1;
+}
+
+int newNode(int kind, int op, int a, int b) {
+  int n = newNode(kind);
+  nodes[n].op = op;
+  nodes[n].a = a;
+  nodes[n].b = b;
+  return n;
+}
+
+int newValueNode(int kind, int64_t value) {
+  int n = newNode(kind);
+  nodes[n].value = value;
+  return n;
+}
+
+int nodeCount() {
+  return arena.size();
+}
+
+void clearNodes() {
+  arena.resize(1);
+  nodes = &arena[0];
+}
+
+void postOrder(int n, vector<int> &order) {
+  order.clear();
+  // a node is pushed once to have its operands visited and stays on the
+  // stack, marked, until they are done
+  vector<pair<int, bool> > stack(1, make_pair(n, false));
+  while (!stack.empty()) {
+    pair<int, bool> &top = stack.back();
+    const Node &e = nodes[top.first];
+    if (top.second || (e.kind != NODE_NOT && e.kind != NODE_BINARY && e.kind != NODE_COMPARE)) {
+      order.push_back(top.first);
+      stack.pop_back();
+      continue;
+    }
+    top.second = true;
+    if (e.kind != NODE_NOT)
+      stack.push_back(make_pair(e.b, false));
+    stack.push_back(make_pair(e.a, false));
+  }
+}
+
+bool evaluate(int n, int64_t &value) {
+  static thread_local vector<int> order;
+  static thread_local vector<int64_t> values;
+  postOrder(n, order);
+  values.clear();
+  for (size_t i = 0; i < order.size(); i++) {
+    const Node &e = nodes[order[i]];
+    int64_t a, b;
+    switch (e.kind) {
+    case NODE_CONST:
+      values.push_back(e.value);
+      break;
+    case NODE_NOT:
+      values.back() = foldNot(values.back());
+      break;
+    case NODE_BINARY:
+    case NODE_COMPARE:
+      b = values.back();
+      values.pop_back();
+      a = values.back();
+      if (!foldOperator(e.op, a, b, values.back()))
+        return false;
+      break;
+    default:
+      return false;
+    }
+  }
+  value = values.back();
+  return true;
+}
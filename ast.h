@@ -0,0 +1,89 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdint.h>
+#include <vector>
+
+// abstract syntax tree built by the parser and walked by code generation
+//
+// nodes live in one arena and refer to each other by index, index 0 is
+// never a real node so NO_NODE doubles as a null child
+
+const int NO_NODE = 0;
+
+// node kinds, the fields each one uses are listed alongside
+enum NodeKind {
+  NODE_PROGRAM,     // a = first DIM, b = main BLOCK
+  NODE_DIM,         // value = identifier id, op = type, b = initial value
+  NODE_BLOCK,       // a = first statement
+  NODE_IF,          // a = condition, b = then BLOCK, c = else BLOCK or NO_NODE
+  NODE_WHILE,       // a = condition, b = body BLOCK
+  NODE_READ,        // a = first VAR or PARAM to read into
+  NODE_WRITE,       // a = first expression to write
+  NODE_SUB,         // value = identifier id, a = body BLOCK,
+                    //   b = formal parameter count, c = local variable count
+  NODE_CALL,        // value = identifier id, a = first argument
+  NODE_ASSIGN,      // a = VAR or PARAM target, b = expression
+  NODE_CONST,       // value = constant
+  NODE_VAR,         // value = identifier id of a global
+  NODE_PARAM,       // value = parameter number
+  NODE_BINARY,      // op = OP_ADD, OP_SUB, OP_MULT, OP_DIV, OP_REL_A, OP_OR
+                    //   or OP_XOR, a = left, b = right
+  NODE_COMPARE,     // op = OP_REL_E, OP_REL_NE, OP_REL_L, OP_REL_G,
+                    //   OP_REL_LE or OP_REL_GE, a = left, b = right
+  NODE_NOT          // a = operand
+};
+
+struct Node {
+  uint8_t kind;
+  int16_t op;
+  uint32_t line;    // source line, saturated at 2^32-1
+  int32_t a, b, c;  // children or counts, see NodeKind
+  int32_t next;     // next node in a statement, argument or DIM list
+  int64_t value;
+};
+
+// the arena, index with a node number
+extern thread_local Node *nodes;
+
+//add a node of kind on the current source line, returns its index
+int newNode(int kind);
+
+//add a node with two children
+int newNode(int kind, int op, int a, int b);
+
+//add a node holding a value
+int newValueNode(int kind, int64_t value);
+
+//number of nodes in the arena including the unused node 0
+int nodeCount();
+
+//empty the arena
+void clearNodes();
+
+//the expression tree at n in evaluation order, every node after its
+//operands and left operands first. Walked with a stack on the heap, so
+//trees of any depth can be visited without recursion
+void postOrder(int n, std::vector<int> &order);
+
+//value of a tree made only of constants, false if it reads a variable or
+//can't be computed before run time
+bool evaluate(int n, int64_t &value);
+
+//helper to append nodes to a list linked through next
+struct NodeList {
+  int first;
+  int last;
+  int count;
+  NodeList() : first(NO_NODE), last(NO_NODE), count(0) {}
+  void add(int n) {
+    if (first == NO_NODE)
+      first = n;
+    else
+      nodes[last].next = n;
+    last = n;
+    count++;
+  }
+};
+
+#endif // AST_H
@@ -0,0 +1,68 @@
+#include "b4gl.h"
+#include "assembler.h"
+#include "codegen.h"
+#include "elfWriter.h"
+#include "ir.h"
+#include "outputBuffer.h"
+#include "peephole.h"
+#include "sourceReader.h"
+#include "trace.h"
+
+#include <thread>
+
+using namespace std;
+
+extern thread_local bool writeAssembly;
+extern thread_local bool optimize;
+extern thread_local bool RAISE_ERRORS;
+extern int CURRENT_OS;
+extern int OS_WINDOWS;
+void startParse();
+int prog();
+
+B4glOptions b4glDefaultOptions() {
+  B4glOptions options = {true, false};
+  return options;
+}
+
+//the whole compilation, on a fresh thread so the compiler state is new
+static void compileSource(const char *source, size_t length, B4glOptions options, B4glResult *result) {
+  RAISE_ERRORS = true;
+  optimize = peepholeEnabled = options.optimize;
+  writeAssembly = options.assembly;
+  try {
+    if (!options.assembly && CURRENT_OS == OS_WINDOWS)
+      throw B4glDiagnostic{0, "object files are only written for linux"};
+    sourceOpenBuffer(source, length);
+    startParse();
+    buildIr(prog());
+    if (optimize)
+      optimizeIr();
+    generate();
+    flushLines();
+    if (options.assembly) {
+      result->output = outputContents();
+    } else {
+      finishAssembly();
+      vector<uint8_t> bytes = objectFileBytes();
+      result->output.assign(bytes.begin(), bytes.end());
+    }
+    result->ok = true;
+  } catch (const B4glDiagnostic &diagnostic) {
+    result->ok = false;
+    result->output.clear();
+    result->diagnostics.push_back(diagnostic);
+  }
+  writeAssembly = false;
+  outputClear();
+  sourceClose();
+}
+
+B4glResult b4glCompile(const char *source, size_t length, B4glOptions options) {
+  TRACE(TRACE_LEVEL_PHASE, "b4glCompile(%d)", (int64_t)length);
+  B4glResult result;
+  result.ok = false;
+  thread compilation(compileSource, source, length, options, &result);
+  compilation.join();
+  return result;
+}
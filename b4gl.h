@@ -0,0 +1,42 @@
+#ifndef B4GL_H
+#define B4GL_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// the compiler as a library, for programs that build b4gl code themselves
+//
+// b4glCompile translates source text held in memory and hands back the
+// assembly or the ELF64 object in memory. Nothing is read from or written
+// to disk and nothing is printed, an error in the source comes back as a
+// diagnostic instead of ending the process. The compiler keeps its state
+// in thread local globals and every call runs on a thread of its own, so
+// calls may be made from several threads at once.
+//
+// build with B4GL_LIBRARY defined to leave main out
+
+struct B4glOptions {
+  bool optimize;   // false is -O0
+  bool assembly;   // nasm text instead of an object file
+};
+
+struct B4glDiagnostic {
+  uint64_t line;   // source line the compiler was at, from 1
+  std::string message;
+};
+
+struct B4glResult {
+  bool ok;
+  std::string output;  // assembly text or object file bytes, empty on error
+  std::vector<B4glDiagnostic> diagnostics;
+};
+
+//optimized object file
+B4glOptions b4glDefaultOptions();
+
+//compile length bytes of source, the text is only read during the call
+B4glResult b4glCompile(const char *source, size_t length, B4glOptions options);
+
+#endif // B4GL_H
@@ -0,0 +1,76 @@
+#!/bin/sh
+# compile throughput on generated programs
+#
+# builds benchmarks/programGenerator.cpp, writes a program of every shape
+# at the given size and compiles each one repeat times with --metrics=json,
+# keeping the fastest time of each phase. For every shape it reports the
+# source lines and bytes, then the time and the lines and bytes per second
+# of
+#   parse     lexing and parsing, the lexer runs as the parser asks for
+#             tokens so the two can't be timed apart
+#   ir        lowering to IR and optimizing it
+#   codegen   register allocation, emission and the peephole pass
+# and apart from those the in-process assembler and linker, and nasm and
+# gcc with -S when nasm is on the PATH (null otherwise). The output is one
+# json object with its keys always in the same order.
+#
+#   sh benchmarks/compileBench.sh path/to/b4glCompilerLinux [size] [repeat]
+
+compiler=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+size=${2:-2000}
+repeat=${3:-5}
+here=$(cd "$(dirname "$0")" && pwd)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+c++ -std=c++11 -O2 -o "$dir/programGenerator" "$here/programGenerator.cpp" || exit 1
+cd "$dir" || exit 1
+
+# wall time of a phase in a metrics file, in ms
+phase() {
+  sed -n "s/.*\"$2\":{\"wall_ms\":\([0-9.e+-]*\).*/\1/p" "$1"
+}
+
+# times of repeat builds, one line each: parse, ir, codegen, assembler
+# and linker in ms. buildTimes file flags
+buildTimes() {
+  run=0
+  while [ $run -lt "$repeat" ]; do
+    "$compiler" -nocache $2 --metrics=json:metrics.json "$1" > /dev/null 2>&1 || return 1
+    awk "BEGIN { print $(phase metrics.json parse), $(phase metrics.json ir) + $(phase metrics.json optimize),
+      $(phase metrics.json codegen), $(phase metrics.json assemble) + $(phase metrics.json link) }"
+    run=$((run + 1))
+  done
+}
+
+# fastest time in a column of buildTimes
+fastest() {
+  awk -v c="$2" 'NR == 1 || $c < min { min = $c } END { print min }' "$1"
+}
+
+# "name":{"ms":..,"lines_per_s":..,"bytes_per_s":..}
+rate() {
+  awk "BEGIN { s = $2 / 1000; if (s <= 0) s = 1e-9;
+    printf \"\\\"%s\\\":{\\\"ms\\\":%.3f,\\\"lines_per_s\\\":%.0f,\\\"bytes_per_s\\\":%.0f}\", \"$1\", $2, $3 / s, $4 / s }"
+}
+
+printf '{"size":%d,"repeat":%d,"shapes":[' "$size" "$repeat"
+separator=
+for shape in subs nesting expression globals locals; do
+  "$dir/programGenerator" $shape "$size" > $shape.txt || exit 1
+  lines=$(wc -l < $shape.txt | tr -d ' ')
+  bytes=$(wc -c < $shape.txt | tr -d ' ')
+  buildTimes $shape.txt "" > times.txt || { echo "failed to compile $shape" >&2; exit 1; }
+  external=null
+  if command -v nasm > /dev/null && buildTimes $shape.txt -S > external.txt; then
+    external=$(fastest external.txt 4)
+  fi
+  printf '%s{"shape":"%s","lines":%d,"bytes":%d,%s,%s,%s,"assemble_link_ms":%.3f,"nasm_gcc_ms":%s}' \
+    "$separator" $shape "$lines" "$bytes" \
+    "$(rate parse "$(fastest times.txt 1)" "$lines" "$bytes")" \
+    "$(rate ir "$(fastest times.txt 2)" "$lines" "$bytes")" \
+    "$(rate codegen "$(fastest times.txt 3)" "$lines" "$bytes")" \
+    "$(fastest times.txt 4)" "$external"
+  separator=,
+done
+printf ']}\n'
@@ -0,0 +1,97 @@
+// microbenchmark of keyword and operator recognition
+//
+// compares the linear tableLookup() scan the lexer used to do against the
+// perfect hash and dispatch table in keywords.h
+//
+//   g++ -std=c++11 -O2 -o lookupBench benchmarks/lookupBench.cpp
+//   ./lookupBench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "../keywords.h"
+
+using namespace std;
+
+static string operatorList[] = {"|","~","+","-","*","/","=","#","<",">","(",")","!","&", ",",";"};
+static string keywordList[] = {"if", "else", "endif", "while", "wend", "dim", "main", "endmain", "read", "write", "sub", "endsub"};
+
+// the lookup the lexer used before keywords.h, minus its debug() call
+static int tableLookup(string table[], string s, int n) {
+  bool found = false;
+  int i = n;
+
+  while (i > 0 && !found) {
+    if (table[i-1].compare(s) == 0) {
+      found = true;
+    } else {
+      i--;
+    }
+  }
+  if (s == "$") {
+    return TYPE_STRING;
+  } else if (s == "#") {
+    return TYPE_FLOAT;
+  }
+  return i;
+}
+
+// words in roughly the mix the lexer sees in examples/test.txt
+static const char *words[] = {
+  "dim", "newline", "i", "limiter", "count", "sub", "writeme", "char",
+  "write", "endsub", "woo", "a", "while", "if", "else", "endif", "wend",
+  "localvartest", "read", "x", "total", "main", "endmain", "counter"
+};
+static const char operators[] = "=+-*/<>()!&|~,;#$";
+
+static double elapsed(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  long iterations = argc > 1 ? atol(argv[1]) : 2000000;
+  int wordCount = sizeof(words) / sizeof(words[0]);
+  int operatorCount = sizeof(operators) - 1;
+
+  vector<string> names;
+  for (int i = 0; i < wordCount; i++)
+    names.push_back(words[i]);
+  vector<string> ops;
+  for (int i = 0; i < operatorCount; i++)
+    ops.push_back(string(1, operators[i]));
+
+  // both sides fold every result into sum so nothing is optimized away
+  long sum = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+    sum += tableLookup(keywordList, names[i % wordCount], 12);
+  double oldKeywords = elapsed(start);
+
+  start = chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+    sum += tableLookup(operatorList, ops[i % operatorCount], 16);
+  double oldOperators = elapsed(start);
+
+  start = chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+    sum += keywordToken(names[i % wordCount]);
+  double newKeywords = elapsed(start);
+
+  start = chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+    sum += operatorToken(operators[i % operatorCount]) + suffixType(operators[i % operatorCount]);
+  double newOperators = elapsed(start);
+
+  printf("%-12s %12s %12s %10s\n", "lookup", "table ns", "hash ns", "speedup");
+  printf("%-12s %12.2f %12.2f %9.1fx\n", "keywords",
+         oldKeywords * 1e9 / iterations, newKeywords * 1e9 / iterations,
+         oldKeywords / newKeywords);
+  printf("%-12s %12.2f %12.2f %9.1fx\n", "operators",
+         oldOperators * 1e9 / iterations, newOperators * 1e9 / iterations,
+         oldOperators / newOperators);
+  printf("(checksum %ld)\n", sum);
+  return 0;
+}
@@ -0,0 +1,141 @@
+// generator of b4gl programs for the compile throughput benchmark
+//
+// writes a program of the given shape and size to stdout. The same shape
+// and size always give the same program, so timings can be compared from
+// one compiler to the next. Every program runs to the end quickly, the
+// compiler runs what it builds: loops go round once and each sub calls
+// only the one before it.
+//
+//   subs N         N subs with parameters, locals, ifs and whiles
+//   nesting N      ifs and whiles nested N deep
+//   expression N   assignments of N term expressions
+//   globals N      N dim globals, all read and written
+//   locals N       a sub with N locals
+//
+//   g++ -std=c++11 -O2 -o programGenerator benchmarks/programGenerator.cpp
+//   ./programGenerator subs 2000 > subs.txt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace std;
+
+static unsigned long long seed = 88172645463325252ULL;
+
+//the next pseudo random number below n, xorshift so every platform agrees
+static int randomBelow(int n) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return (int)(seed % (unsigned long long)n);
+}
+
+//an expression of terms operands, divisors are constants that aren't 0
+static string expression(int terms, const string *operands, int operandCount) {
+  static const char *operators[] = {" + ", " - ", " * ", " / "};
+  string e = operands[randomBelow(operandCount)];
+  for (int t = 1; t < terms; t++) {
+    int op = randomBelow(4);
+    string operand = op == 3 ? to_string(2 + randomBelow(9)) : operands[randomBelow(operandCount)];
+    if (randomBelow(4) == 0)
+      operand = "(" + operand + " + " + to_string(randomBelow(100)) + ")";
+    e += operators[op] + operand;
+  }
+  return e;
+}
+
+static void subs(int count) {
+  printf("dim total = 0\n\n");
+  for (int s = 0; s < count; s++) {
+    // locals share one symbol table with the globals, every sub needs
+    // names of its own
+    string x = "x" + to_string(s), y = "y" + to_string(s), w = "w" + to_string(s);
+    printf("sub s%d(a, b)\n", s);
+    printf("\tdim %s = %d\n\tdim %s\n\tdim %s = 0\n", x.c_str(), randomBelow(1000), y.c_str(), w.c_str());
+    string operands[] = {"a", "b", x, "total"};
+    printf("\t%s = %s\n", y.c_str(), expression(4, operands, 4).c_str());
+    printf("\tif (a > b)\n\t\t%s = %s + a\n\telse\n\t\t%s = %s - b\n\tendif\n", x.c_str(), x.c_str(), x.c_str(), x.c_str());
+    printf("\twhile (%s < 1)\n\t\ttotal = total + %s - %s / 3\n\t\t%s = %s + 1\n\twend\n",
+           w.c_str(), x.c_str(), y.c_str(), w.c_str(), w.c_str());
+    if (s > 0)
+      printf("\ts%d(%s, %s)\n", s - 1, x.c_str(), y.c_str());
+    printf("endsub\n\n");
+  }
+  if (count > 0)
+    printf("s%d(1, 2)\n", count - 1);
+  printf("write(48 + total - total / 10 * 10, 10)\n");
+}
+
+static void nesting(int depth) {
+  printf("dim total = 0\n");
+  for (int d = 0; d < depth; d++)
+    printf("dim c%d = 0\n", d);
+  printf("\n");
+  for (int d = 0; d < depth; d++) {
+    string indent(d, '\t');
+    if (d % 2 == 0)
+      printf("%sif (total < %d)\n", indent.c_str(), 1000000 + d);
+    else
+      printf("%swhile (c%d < 1)\n%s\tc%d = c%d + 1\n", indent.c_str(), d, indent.c_str(), d, d);
+    printf("%s\ttotal = total + %d\n", indent.c_str(), d);
+  }
+  for (int d = depth - 1; d >= 0; d--)
+    printf("%s%s\n", string(d, '\t').c_str(), d % 2 == 0 ? "endif" : "wend");
+  printf("write(48 + total - total / 10 * 10, 10)\n");
+}
+
+static void expressions(int terms) {
+  printf("dim a = 3\ndim b = 5\ndim c = 7\ndim total = 0\n\n");
+  string operands[] = {"a", "b", "c", "total", "11", "13"};
+  for (int i = 0; i < 8; i++)
+    printf("total = %s\n", expression(terms, operands, 6).c_str());
+  printf("write(48 + total - total / 10 * 10, 10)\n");
+}
+
+static void globals(int count) {
+  for (int g = 0; g < count; g++)
+    printf("dim g%d = %d\n", g, randomBelow(1000));
+  printf("\n");
+  for (int g = 1; g < count; g++)
+    printf("g%d = g%d + g%d * 3 - %d\n", g, g - 1, randomBelow(count), randomBelow(100));
+  printf("write(48 + g%d - g%d / 10 * 10, 10)\n", count - 1, count - 1);
+}
+
+static void locals(int count) {
+  printf("dim total = 0\n\nsub many(a)\n");
+  for (int l = 0; l < count; l++)
+    printf("\tdim l%d = %d\n", l, randomBelow(1000));
+  for (int l = 1; l < count; l++)
+    printf("\tl%d = l%d + l%d - a\n", l, l - 1, randomBelow(count));
+  printf("\ttotal = l%d\nendsub\n\nmany(7)\n", count - 1);
+  printf("write(48 + total - total / 10 * 10, 10)\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: programGenerator subs|nesting|expression|globals|locals size\n");
+    return 1;
+  }
+  string shape = argv[1];
+  int size = atoi(argv[2]);
+  if (size < 1) {
+    fprintf(stderr, "size must be at least 1\n");
+    return 1;
+  }
+  if (shape == "subs") {
+    subs(size);
+  } else if (shape == "nesting") {
+    nesting(size);
+  } else if (shape == "expression") {
+    expressions(size);
+  } else if (shape == "globals") {
+    globals(size);
+  } else if (shape == "locals") {
+    locals(size);
+  } else {
+    fprintf(stderr, "unknown shape: %s\n", shape.c_str());
+    return 1;
+  }
+  return 0;
+}
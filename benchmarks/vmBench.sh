@@ -0,0 +1,58 @@
+#!/bin/sh
+# throughput of the bytecode interpreter against the native backend
+#
+# runs a program made of examples/test.txt style loops, nested whiles with
+# globals, locals and subroutine calls, once as a native executable and
+# once with -vm, and reports both times and how many times slower the
+# interpreter is. The native time is just the executable, the -vm time
+# includes parsing and translating the source, which is what a -vm run
+# costs.
+#
+#   sh benchmarks/vmBench.sh path/to/b4glCompilerLinux [outer iterations]
+
+compiler=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+iterations=${2:-2000}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/loops.txt" <<PROGRAM
+dim newline = 10
+dim i = 0
+dim total = 0
+
+sub mix(a, b)
+	dim j = 0
+	while (j < 100)
+		if (a > b)
+			total = total + a - b
+		else
+			total = total + (b - a) * 3 / 2
+		endif
+		a = a + 7
+		b = b + j
+		j = j + 1
+	wend
+endsub
+
+while (i < $iterations)
+	mix(i, i / 2)
+	i = i + 1
+wend
+write(48 + total / 100 - total / 1000 * 10, 48 + total / 10 - total / 100 * 10)
+write(48 + total - total / 10 * 10, newline)
+PROGRAM
+
+elapsed() {
+  start=$(date +%s%N)
+  "$@" > /dev/null
+  end=$(date +%s%N)
+  echo $(( (end - start) / 1000 ))
+}
+
+cd "$dir" || exit 1
+"$compiler" loops.txt > /dev/null || exit 1
+native=$(elapsed ./loops)
+vm=$(elapsed "$compiler" -vm loops.txt)
+echo "native:  $native us"
+echo "-vm:     $vm us"
+echo "ratio:   $(awk "BEGIN { printf \"%.1f\", $vm / $native }")x"
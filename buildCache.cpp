@@ -0,0 +1,226 @@
+#include "buildCache.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <utime.h>
+
+#ifdef __linux
+#include <unistd.h>
+#else
+#include <direct.h>
+#include <process.h>
+#endif
+
+using namespace std;
+
+
+static const uint64_t DEFAULT_SIZE_MB = 512;
+// a store that hasn't finished in this long was cut short, its directory
+// is removed
+static const time_t STALE_STORE_SECONDS = 3600;
+
+static string cacheDirectory() {
+  const char *dir = getenv("B4GL_CACHE");
+  if (dir != NULL)
+    return dir;
+#ifdef __linux
+  const char *home = getenv("HOME");
+  return home != NULL ? string(home) + "/.cache/b4gl" : "";
+#else
+  const char *local = getenv("LOCALAPPDATA");
+  return local != NULL ? string(local) + "\\b4gl" : "";
+#endif
+}
+
+static bool makeDirectory(const string &path) {
+#ifdef __linux
+  return mkdir(path.c_str(), 0755) == 0;
+#else
+  return _mkdir(path.c_str()) == 0;
+#endif
+}
+
+//create path and every directory above it that is missing
+static void makeDirectories(const string &path) {
+  for (size_t i = 1; i <= path.size(); i++)
+    if (i == path.size() || path[i] == '/' || path[i] == '\\')
+      makeDirectory(path.substr(0, i));
+}
+
+static bool readFile(const string &name, string &contents) {
+  ifstream file(name.c_str(), ios::in | ios::binary);
+  if (!file)
+    return false;
+  stringstream ss;
+  ss << file.rdbuf();
+  contents = ss.str();
+  return true;
+}
+
+static bool writeFile(const string &name, const string &contents) {
+  ofstream file(name.c_str(), ios::out | ios::binary | ios::trunc);
+  if (!file)
+    return false;
+  file.write(contents.data(), contents.size());
+  return file.good();
+}
+
+//copy a file, keeping it executable
+static bool copyFile(const string &from, const string &to) {
+  string contents;
+  if (!readFile(from, contents) || !writeFile(to, contents))
+    return false;
+#ifdef __linux
+  chmod(to.c_str(), 0755);
+#endif
+  return true;
+}
+
+//names in a directory other than . and ..
+static vector<string> listDirectory(const string &path) {
+  vector<string> names;
+  DIR *dir = opendir(path.c_str());
+  if (dir == NULL)
+    return names;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    string name = entry->d_name;
+    if (name != "." && name != "..")
+      names.push_back(name);
+  }
+  closedir(dir);
+  return names;
+}
+
+//remove an entry and the files in it
+static void removeEntry(const string &path) {
+  vector<string> names = listDirectory(path);
+  for (size_t i = 0; i < names.size(); i++)
+    remove((path + "/" + names[i]).c_str());
+  rmdir(path.c_str());
+}
+
+//64 bit FNV-1a
+static uint64_t hashBytes(uint64_t hash, const string &bytes) {
+  for (size_t i = 0; i < bytes.size(); i++) {
+    hash ^= (uint8_t)bytes[i];
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+//size and time of the compiler executable, part of every key so a rebuilt
+//compiler doesn't reuse what the old one made
+static string compilerBuild() {
+#ifdef __linux
+  const char *self = "/proc/self/exe";
+#else
+  const char *self = _pgmptr;
+#endif
+  struct stat info;
+  stringstream ss;
+  if (self != NULL && stat(self, &info) == 0)
+    ss << info.st_size << ' ' << info.st_mtime;
+  ss << ' ' << __DATE__ << ' ' << __TIME__;
+  return ss.str();
+}
+
+string cacheKey(string sourceFile, string settings) {
+  string dir = cacheDirectory();
+  string source;
+  if (dir.empty() || !readFile(sourceFile, source))
+    return "";
+  // two hashes from different starting points make a 128 bit key
+  string prefix = compilerBuild() + '\0' + settings + '\0';
+  uint64_t first = hashBytes(hashBytes(0xCBF29CE484222325ULL, prefix), source);
+  uint64_t second = hashBytes(hashBytes(0x84222325CBF29CE4ULL, source), prefix);
+  char key[33];
+  snprintf(key, sizeof(key), "%016llx%016llx", (unsigned long long)first, (unsigned long long)second);
+  TRACE(TRACE_LEVEL_PHASE, "cacheKey(%s)", string(key));
+  return key;
+}
+
+bool cacheRestore(string key, string baseName, const vector<string> &suffixes) {
+  string entry = cacheDirectory() + "/" + key;
+  for (size_t i = 0; i < suffixes.size(); i++)
+    if (!copyFile(entry + "/artifact" + suffixes[i], baseName + suffixes[i]))
+      return false;
+  utime(entry.c_str(), NULL);  // used now
+  TRACE(TRACE_LEVEL_PHASE, "cacheRestore(%s)", key);
+  return true;
+}
+
+//drop the least recently used entries until the cache fits its limit, and
+//the directories of stores that never finished
+static void evict(const string &dir) {
+  const char *limit = getenv("B4GL_CACHE_SIZE");
+  uint64_t maxBytes = (limit != NULL ? strtoull(limit, NULL, 10) : DEFAULT_SIZE_MB) << 20;
+  vector<pair<time_t, string> > entries;
+  vector<uint64_t> sizes;
+  uint64_t total = 0;
+  time_t now = time(NULL);
+  vector<string> names = listDirectory(dir);
+  for (size_t i = 0; i < names.size(); i++) {
+    string path = dir + "/" + names[i];
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+      continue;
+    if (names[i].compare(0, 4, "tmp-") == 0) {
+      if (now - info.st_mtime > STALE_STORE_SECONDS)
+        removeEntry(path);
+      continue;
+    }
+    uint64_t size = 0;
+    vector<string> files = listDirectory(path);
+    for (size_t f = 0; f < files.size(); f++) {
+      struct stat fileInfo;
+      if (stat((path + "/" + files[f]).c_str(), &fileInfo) == 0)
+        size += fileInfo.st_size;
+    }
+    entries.push_back(make_pair(info.st_mtime, path));
+    sizes.push_back(size);
+    total += size;
+  }
+  vector<size_t> byAge(entries.size());
+  for (size_t i = 0; i < byAge.size(); i++)
+    byAge[i] = i;
+  sort(byAge.begin(), byAge.end(), [&](size_t a, size_t b) { return entries[a].first < entries[b].first; });
+  for (size_t i = 0; i < byAge.size() && total > maxBytes; i++) {
+    removeEntry(entries[byAge[i]].second);
+    total -= sizes[byAge[i]];
+  }
+}
+
+void cacheStore(string key, string baseName, const vector<string> &suffixes) {
+  string dir = cacheDirectory();
+  makeDirectories(dir);
+  // fill a private directory and rename it into place, if another compiler
+  // got there first the rename fails and its entry stays
+  static atomic<unsigned> stores(0);
+  stringstream ss;
+  ss << dir << "/tmp-" << getpid() << "-" << stores++ << "-" << key;
+  string temp = ss.str();
+  makeDirectory(temp);
+  for (size_t i = 0; i < suffixes.size(); i++) {
+    if (!copyFile(baseName + suffixes[i], temp + "/artifact" + suffixes[i])) {
+      removeEntry(temp);
+      return;
+    }
+  }
+  if (rename(temp.c_str(), (dir + "/" + key).c_str()) != 0) {
+    removeEntry(temp);
+    return;
+  }
+  TRACE(TRACE_LEVEL_PHASE, "cacheStore(%s)", key);
+  evict(dir);
+}
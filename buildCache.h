@@ -0,0 +1,31 @@
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+#include <string>
+#include <vector>
+
+// a cache of finished builds, shared by every run of the compiler
+//
+// an entry is a directory named after the hash of the source bytes and
+// everything else that decides the output (compiler build, target os and
+// flags), holding a copy of each file the build made. Entries are put in
+// place with a single rename so a reader never sees half of one. The
+// modification time of an entry records its last use, the least recently
+// used ones go once the cache grows past its size limit.
+//
+// the cache lives in $B4GL_CACHE, else in ~/.cache/b4gl or on windows in
+// %LOCALAPPDATA%\b4gl. $B4GL_CACHE_SIZE is the limit in megabytes.
+
+//key for a build of sourceFile with the given settings, "" when there is
+//no cache to use or the source can't be read
+std::string cacheKey(std::string sourceFile, std::string settings);
+
+//copy the files of a cached build to baseName + each suffix, false if the
+//build isn't cached
+bool cacheRestore(std::string key, std::string baseName, const std::vector<std::string> &suffixes);
+
+//add the files baseName + each suffix to the cache, nothing is added if
+//one of them is missing
+void cacheStore(std::string key, std::string baseName, const std::vector<std::string> &suffixes);
+
+#endif // BUILD_CACHE_H
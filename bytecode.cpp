@@ -0,0 +1,275 @@
+#include "bytecode.h"
+#include "ir.h"
+#include "tokens.h"
+#include "trace.h"
+
+#include <map>
+
+using namespace std;
+
+thread_local vector<int32_t> bytecode;
+thread_local vector<int> bytecodeOps;
+thread_local vector<BytecodeFunction> bytecodeFunctions;
+thread_local vector<int64_t> bytecodeGlobals;
+
+static thread_local const IrFunction *fn;
+static thread_local vector<int> slot;        // frame slot of each value
+static thread_local int spare;               // slot the phi copies park a value in
+static thread_local vector<int> order;
+static thread_local vector<int> position;    // of each block in order
+static thread_local vector<int> blockStart;  // word position of each block
+static thread_local vector<pair<int,int> > fixups;  // word to patch, block it targets
+static thread_local map<int,int> globalIndex;       // identifier id to bytecodeGlobals
+static thread_local map<int,int> functionIndex;     // identifier id to bytecodeFunctions
+
+static void op(int code) {
+  bytecodeOps.push_back(bytecode.size());
+  bytecode.push_back(code);
+}
+
+static void word(int w) {
+  bytecode.push_back(w);
+}
+
+//a branch target, patched once every block has its position
+static void target(int block) {
+  fixups.push_back(make_pair(bytecode.size(), block));
+  bytecode.push_back(0);
+}
+
+static bool isNext(int b, int block) {
+  return position[block] == position[b] + 1;
+}
+
+//operation for a relation, as a value or as a branch
+static int relation(int cond, bool jump) {
+  static const int values[] = {BC_EQ, BC_NE, BC_LT, BC_GT, BC_LE, BC_GE};
+  static const int jumps[] = {BC_JUMP_EQ, BC_JUMP_NE, BC_JUMP_LT, BC_JUMP_GT, BC_JUMP_LE, BC_JUMP_GE};
+  int r;
+  switch (cond) {
+  case OP_REL_E:  r = 0; break;
+  case OP_REL_NE: r = 1; break;
+  case OP_REL_L:  r = 2; break;
+  case OP_REL_G:  r = 3; break;
+  case OP_REL_LE: r = 4; break;
+  default:        r = 5; break;
+  }
+  return jump ? jumps[r] : values[r];
+}
+
+//relation that holds when cond does not
+static int invert(int cond) {
+  switch (cond) {
+  case OP_REL_E:  return OP_REL_NE;
+  case OP_REL_NE: return OP_REL_E;
+  case OP_REL_L:  return OP_REL_GE;
+  case OP_REL_G:  return OP_REL_LE;
+  case OP_REL_LE: return OP_REL_G;
+  default:        return OP_REL_L;
+  }
+}
+
+//perform simultaneous copies between slots
+static void parallelCopy(vector<int> dsts, vector<int> srcs) {
+  while (!dsts.empty()) {
+    bool progress = false;
+    for (size_t i = 0; i < dsts.size() && !progress; i++) {
+      bool blocked = false;
+      for (size_t j = 0; j < srcs.size() && !blocked; j++)
+        blocked = j != i && srcs[j] == dsts[i];
+      if (blocked)
+        continue;
+      op(BC_MOVE);
+      word(dsts[i]);
+      word(srcs[i]);
+      dsts.erase(dsts.begin() + i);
+      srcs.erase(srcs.begin() + i);
+      progress = true;
+    }
+    if (progress)
+      continue;
+    // only cycles are left, park one destination so its copy can go
+    op(BC_MOVE);
+    word(spare);
+    word(dsts[0]);
+    for (size_t j = 0; j < srcs.size(); j++)
+      if (srcs[j] == dsts[0])
+        srcs[j] = spare;
+  }
+}
+
+//copy the values a block hands to the phis of its successor
+static void phiCopies(int b) {
+  const IrBlock &block = fn->blocks[b];
+  if (block.succs.size() != 1)
+    return;
+  const IrBlock &succ = fn->blocks[block.succs[0]];
+  size_t edge = 0;
+  while (succ.preds[edge] != b)
+    edge++;
+  vector<int> dsts, srcs;
+  for (size_t p = 0; p < succ.phis.size(); p++) {
+    int dst = slot[succ.phis[p].dst];
+    int src = slot[succ.phis[p].args[edge]];
+    if (dst != src) {
+      dsts.push_back(dst);
+      srcs.push_back(src);
+    }
+  }
+  parallelCopy(dsts, srcs);
+}
+
+static void instruction(int b, const IrInst &i, vector<int> &args) {
+  static const int binary[] = {BC_ADD, BC_SUB, BC_MUL, BC_DIV, BC_AND, BC_OR, BC_XOR};
+  const IrBlock &block = fn->blocks[b];
+  switch (i.op) {
+  case IR_CONST:
+  case IR_PARAM:
+    break;  // already in the frame
+  case IR_LOAD:
+    op(BC_LOAD);
+    word(slot[i.dst]);
+    word(globalIndex[i.imm]);
+    break;
+  case IR_STORE:
+    op(BC_STORE);
+    word(globalIndex[i.imm]);
+    word(slot[i.a]);
+    break;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+  case IR_AND:
+  case IR_OR:
+  case IR_XOR:
+    op(binary[i.op - IR_ADD]);
+    word(slot[i.dst]);
+    word(slot[i.a]);
+    word(slot[i.b]);
+    break;
+  case IR_NOT:
+    op(BC_NOT);
+    word(slot[i.dst]);
+    word(slot[i.a]);
+    break;
+  case IR_CMP:
+    op(relation(i.cond, false));
+    word(slot[i.dst]);
+    word(slot[i.a]);
+    word(slot[i.b]);
+    break;
+  case IR_ARG:
+    args.push_back(slot[i.a]);
+    break;
+  case IR_CALL:
+    op(BC_CALL);
+    word(functionIndex[i.imm]);
+    word(spare + 1);
+    word(args.size());
+    for (size_t a = 0; a < args.size(); a++)
+      word(args[a]);
+    args.clear();
+    break;
+  case IR_READ:
+    op(BC_READ);
+    word(slot[i.dst]);
+    break;
+  case IR_WRITE:
+    op(BC_WRITE);
+    word(slot[i.a]);
+    break;
+  case IR_JUMP:
+    phiCopies(b);
+    if (!isNext(b, block.succs[0])) {
+      op(BC_JUMP);
+      target(block.succs[0]);
+    }
+    break;
+  case IR_BRANCH: {
+    // jump to one successor and fall through to the other when it comes
+    // next, else jump to both
+    int taken = block.succs[0];
+    int other = block.succs[1];
+    bool flip = isNext(b, taken);
+    if (flip)
+      swap(taken, other);
+    if (i.cond == 0) {
+      op(flip ? BC_JUMP_Z : BC_JUMP_NZ);
+      word(slot[i.a]);
+    } else {
+      op(relation(flip ? invert(i.cond) : i.cond, true));
+      word(slot[i.a]);
+      word(slot[i.b]);
+    }
+    target(taken);
+    if (!isNext(b, other)) {
+      op(BC_JUMP);
+      target(other);
+    }
+    break;
+  }
+  case IR_RETURN:
+    op(BC_RETURN);
+    break;
+  }
+}
+
+static void function(const IrFunction &f) {
+  fn = &f;
+  BytecodeFunction out;
+  out.entry = bytecode.size();
+  // parameters come first so a call can copy its arguments straight in,
+  // the values of IR_PARAM live in them
+  slot.assign(f.valueCount, 0);
+  for (int v = 0; v < f.valueCount; v++)
+    slot[v] = f.paramCount + v;
+  spare = f.paramCount + f.valueCount;
+  out.frame.assign(spare + 1, 0);
+  for (size_t b = 0; b < f.blocks.size(); b++) {
+    const vector<IrInst> &insts = f.blocks[b].insts;
+    for (size_t k = 0; k < insts.size(); k++) {
+      if (insts[k].op == IR_PARAM)
+        slot[insts[k].dst] = insts[k].imm - 1;
+      else if (insts[k].op == IR_CONST)
+        out.frame[slot[insts[k].dst]] = insts[k].imm;
+    }
+  }
+
+  order = blockOrder(f);
+  position.assign(f.blocks.size(), -1);
+  for (size_t k = 0; k < order.size(); k++)
+    position[order[k]] = k;
+  blockStart.assign(f.blocks.size(), -1);
+  fixups.clear();
+  vector<int> args;
+  for (size_t k = 0; k < order.size(); k++) {
+    int b = order[k];
+    blockStart[b] = bytecode.size();
+    const vector<IrInst> &insts = f.blocks[b].insts;
+    for (size_t n = 0; n < insts.size(); n++)
+      instruction(b, insts[n], args);
+  }
+  for (size_t k = 0; k < fixups.size(); k++)
+    bytecode[fixups[k].first] = blockStart[fixups[k].second];
+  bytecodeFunctions.push_back(out);
+}
+
+void buildBytecode() {
+  TRACE(TRACE_LEVEL_PHASE, "buildBytecode()");
+  bytecode.clear();
+  bytecodeOps.clear();
+  bytecodeFunctions.clear();
+  bytecodeGlobals.clear();
+  globalIndex.clear();
+  functionIndex.clear();
+  for (size_t g = 0; g < irGlobals.size(); g++) {
+    globalIndex[irGlobals[g].symbol] = g;
+    bytecodeGlobals.push_back(irGlobals[g].value);
+  }
+  for (size_t f = 0; f < irFunctions.size(); f++)
+    functionIndex[irFunctions[f].symbol] = f;
+  for (size_t f = 0; f < irFunctions.size(); f++)
+    function(irFunctions[f]);
+  TRACE(TRACE_LEVEL_PHASE, "buildBytecode() %d words", (int64_t)bytecode.size());
+}
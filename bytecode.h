@@ -0,0 +1,67 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <vector>
+#include <stdint.h>
+
+// register bytecode for the interpreter, translated from irFunctions
+//
+// every word is 32 bits, an opcode followed by its operands. Operands are
+// slots of the frame of the running function, branch targets are word
+// positions in bytecode. A frame holds the parameters, then a slot for
+// each IR value, then one spare slot the phi copies use. Constants have
+// their slots filled when the frame is set up and cost nothing to use.
+
+enum BytecodeOp {
+  BC_MOVE,      // d = s
+  BC_ADD,       // d = a + b
+  BC_SUB,       // d = a - b
+  BC_MUL,       // d = a * b
+  BC_DIV,       // d = a / b
+  BC_AND,       // d = a & b
+  BC_OR,        // d = a | b
+  BC_XOR,       // d = a ^ b
+  BC_NOT,       // d = ~a
+  BC_EQ,        // d = 1 if a = b else 0
+  BC_NE,        // d = 1 if a <> b else 0
+  BC_LT,        // d = 1 if a < b else 0
+  BC_GT,        // d = 1 if a > b else 0
+  BC_LE,        // d = 1 if a <= b else 0
+  BC_GE,        // d = 1 if a >= b else 0
+  BC_LOAD,      // d = global g
+  BC_STORE,     // global g = a
+  BC_JUMP,      // continue at t
+  BC_JUMP_EQ,   // continue at t if a = b
+  BC_JUMP_NE,   // continue at t if a <> b
+  BC_JUMP_LT,   // continue at t if a < b
+  BC_JUMP_GT,   // continue at t if a > b
+  BC_JUMP_LE,   // continue at t if a <= b
+  BC_JUMP_GE,   // continue at t if a >= b
+  BC_JUMP_Z,    // continue at t if a is 0
+  BC_JUMP_NZ,   // continue at t if a is not 0
+  BC_CALL,      // call function f, frame size of the caller, n, then n
+                //   argument slots
+  BC_READ,      // d = next integer on standard input
+  BC_WRITE,     // write the low byte of a
+  BC_RETURN,    // leave the function, the main program ends the run
+  BC_OP_COUNT
+};
+
+struct BytecodeFunction {
+  int entry;                     // position of the first word
+  std::vector<int64_t> frame;    // initial frame, the constants filled in
+};
+
+// main program first, like irFunctions
+extern thread_local std::vector<int32_t> bytecode;
+extern thread_local std::vector<int> bytecodeOps;  // position of every opcode word
+extern thread_local std::vector<BytecodeFunction> bytecodeFunctions;
+extern thread_local std::vector<int64_t> bytecodeGlobals;  // initial values
+
+//translate irFunctions and irGlobals to bytecode
+void buildBytecode();
+
+//run the bytecode with a direct threaded interpreter
+void interpret();
+
+#endif // BYTECODE_H
@@ -0,0 +1,480 @@
+#include "codegen.h"
+#include "ir.h"
+#include "regAlloc.h"
+#include "peephole.h"
+#include "tokens.h"
+#include "identifiers.h"
+#include "trace.h"
+#include "outputBuffer.h"
+
+#include <limits.h>
+#include <algorithm>
+
+#ifdef __linux
+  #include "linuxasm.h"
+#else
+  #include "winasm.h"
+#endif
+
+using namespace std;
+
+extern void emitLn(string);
+extern void postLabel(string);
+extern string newLabel();
+
+// formal parameter count of the subroutine being translated
+thread_local int base;
+
+// registers reserved by the translation, both targets are x86-64
+static const string PRIMARY = "rax";  // results and memory to memory moves
+static const string SCRATCH = "rbx";  // divisors, wide constants, copy cycles
+
+const int LOC_REGISTER = 0;
+const int LOC_MEMORY   = 1;
+const int LOC_CONSTANT = 2;
+
+// where a value lives, for its whole life
+struct Location {
+  int kind;
+  string text;    // operand for registers and memory
+  int64_t value;  // constants are never stored, they are used in place
+};
+
+static thread_local const IrFunction *fn;
+static thread_local vector<Location> locations;  // indexed by value
+static thread_local vector<string> labels;       // indexed by block, empty if not needed
+static thread_local vector<int> order;           // blocks in the order they are written
+static thread_local vector<int> position;        // where each block is in order
+static thread_local int slotCount;
+static thread_local vector<string> saved;        // callee saved registers in use
+
+static Location registerLocation(string name) {
+  Location l;
+  l.kind = LOC_REGISTER;
+  l.text = name;
+  l.value = 0;
+  return l;
+}
+
+static Location memoryLocation(string operand) {
+  Location l;
+  l.kind = LOC_MEMORY;
+  l.text = operand;
+  l.value = 0;
+  return l;
+}
+
+static Location constantLocation(int64_t value) {
+  Location l;
+  l.kind = LOC_CONSTANT;
+  l.value = value;
+  return l;
+}
+
+static string operand(const Location &l) {
+  if (l.kind != LOC_CONSTANT)
+    return l.text;
+  string text;
+  appendNumber(text, l.value);
+  return text;
+}
+
+//true if a constant can be an immediate operand, x86-64 sign extends 32 bits
+static bool fitsImmediate(const Location &l) {
+  return l.kind != LOC_CONSTANT || (l.value >= INT_MIN && l.value <= INT_MAX);
+}
+
+static bool sameLocation(const Location &a, const Location &b) {
+  return a.kind == b.kind && (a.kind == LOC_CONSTANT ? a.value == b.value : a.text == b.text);
+}
+
+//copy src to dst, through the primary register when both can't be operands
+static void move(const Location &dst, const Location &src) {
+  if (sameLocation(dst, src))
+    return;
+  if (dst.kind == LOC_MEMORY && (src.kind == LOC_MEMORY || !fitsImmediate(src))) {
+    Move(PRIMARY, operand(src));
+    Move(dst.text, PRIMARY);
+  } else {
+    Move(dst.text, operand(src));
+  }
+}
+
+//src as an operand for an instruction whose other operand is a register
+static string source(const Location &src) {
+  if (fitsImmediate(src))
+    return operand(src);
+  Move(SCRATCH, operand(src));
+  return SCRATCH;
+}
+
+//give every value a home, constants stay constants, the rest get the
+//register the allocator picked or a frame slot
+static void assignLocations() {
+  vector<string> registers = allocateRegisters(*fn, order);
+  locations.assign(fn->valueCount, Location());
+  slotCount = 0;
+  saved.clear();
+  for (int v = 0; v < fn->valueCount; v++) {
+    if (registers[v].empty())
+      continue;
+    locations[v] = registerLocation(registers[v]);
+    if (isCalleeSaved(registers[v]) && find(saved.begin(), saved.end(), registers[v]) == saved.end())
+      saved.push_back(registers[v]);
+  }
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    const IrBlock &block = fn->blocks[b];
+    for (size_t p = 0; p < block.phis.size(); p++)
+      if (registers[block.phis[p].dst].empty())
+        locations[block.phis[p].dst] = memoryLocation(frameSlot(slotCount++));
+    for (size_t i = 0; i < block.insts.size(); i++) {
+      const IrInst &inst = block.insts[i];
+      if (inst.dst == NO_VALUE)
+        continue;
+      if (inst.op == IR_CONST) {
+        locations[inst.dst] = constantLocation(inst.imm);
+      } else if (registers[inst.dst].empty()) {
+        locations[inst.dst] = memoryLocation(frameSlot(slotCount++));
+      }
+    }
+  }
+}
+
+//true if target is written right after block b
+static bool isNext(int b, int target) {
+  return position[target] == position[b] + 1;
+}
+
+//lay the blocks out and label the ones reached other than by falling through
+static void assignLabels() {
+  order = blockOrder(*fn);
+  position.assign(fn->blocks.size(), -1);
+  for (size_t i = 0; i < order.size(); i++)
+    position[order[i]] = i;
+  labels.assign(fn->blocks.size(), "");
+  for (size_t i = 0; i < order.size(); i++) {
+    int b = order[i];
+    const IrBlock &block = fn->blocks[b];
+    // a branch jumps to one successor and falls through to the other if it
+    // comes next, else it jumps to both
+    bool fallsThrough = false;
+    for (size_t s = block.succs.size(); s > 0; s--) {
+      int target = block.succs[s - 1];
+      if (!fallsThrough && isNext(b, target))
+        fallsThrough = true;
+      else if (labels[target].empty())
+        labels[target] = newLabel();
+    }
+  }
+}
+
+//perform simultaneous copies, as needed by the phis of a block
+static void parallelCopy(vector<Location> dsts, vector<Location> srcs) {
+  Location temp = registerLocation(SCRATCH);
+  while (!dsts.empty()) {
+    bool progress = false;
+    for (size_t i = 0; i < dsts.size(); i++) {
+      bool blocked = false;
+      for (size_t j = 0; j < srcs.size() && !blocked; j++)
+        blocked = j != i && sameLocation(srcs[j], dsts[i]);
+      if (blocked)
+        continue;
+      move(dsts[i], srcs[i]);
+      dsts.erase(dsts.begin() + i);
+      srcs.erase(srcs.begin() + i);
+      progress = true;
+      break;
+    }
+    if (progress)
+      continue;
+    // only cycles are left, park one destination so its copy can go
+    move(temp, dsts[0]);
+    for (size_t j = 0; j < srcs.size(); j++)
+      if (sameLocation(srcs[j], dsts[0]))
+        srcs[j] = temp;
+  }
+}
+
+//copy the values a block hands to the phis of its successor
+static void phiCopies(int b) {
+  const IrBlock &block = fn->blocks[b];
+  if (block.succs.size() != 1)
+    return;
+  const IrBlock &succ = fn->blocks[block.succs[0]];
+  size_t edge = 0;
+  while (succ.preds[edge] != b)
+    edge++;
+  vector<Location> dsts, srcs;
+  for (size_t p = 0; p < succ.phis.size(); p++) {
+    if (sameLocation(locations[succ.phis[p].dst], locations[succ.phis[p].args[edge]]))
+      continue;
+    dsts.push_back(locations[succ.phis[p].dst]);
+    srcs.push_back(locations[succ.phis[p].args[edge]]);
+  }
+  parallelCopy(dsts, srcs);
+}
+
+//set the primary register from the flags of a compare
+static void setRelation(int cond) {
+  switch (cond) {
+  case OP_REL_E:
+    setEqual();
+    break;
+  case OP_REL_NE:
+    setNEqual();
+    break;
+  case OP_REL_L:
+    setLess();
+    break;
+  case OP_REL_G:
+    setGreater();
+    break;
+  case OP_REL_LE:
+    setLessOrEqual();
+    break;
+  case OP_REL_GE:
+    setGreaterOrEqual();
+    break;
+  }
+}
+
+//relation that holds when cond does not
+static int invert(int cond) {
+  switch (cond) {
+  case OP_REL_E:  return OP_REL_NE;
+  case OP_REL_NE: return OP_REL_E;
+  case OP_REL_L:  return OP_REL_GE;
+  case OP_REL_G:  return OP_REL_LE;
+  case OP_REL_LE: return OP_REL_G;
+  default:        return OP_REL_L;  // OP_REL_GE
+  }
+}
+
+//relation that holds for b cond' a when a cond b does
+static int mirror(int cond) {
+  switch (cond) {
+  case OP_REL_L:  return OP_REL_G;
+  case OP_REL_G:  return OP_REL_L;
+  case OP_REL_LE: return OP_REL_GE;
+  case OP_REL_GE: return OP_REL_LE;
+  default:        return cond;  // OP_REL_E, OP_REL_NE
+  }
+}
+
+static void branchRelation(int cond, string tag) {
+  switch (cond) {
+  case OP_REL_E:
+    branchEqual(tag);
+    break;
+  case OP_REL_NE:
+    branchNEqual(tag);
+    break;
+  case OP_REL_L:
+    branchLess(tag);
+    break;
+  case OP_REL_G:
+    branchGreater(tag);
+    break;
+  case OP_REL_LE:
+    branchLessOrEqual(tag);
+    break;
+  case OP_REL_GE:
+    branchGreaterOrEqual(tag);
+    break;
+  }
+}
+
+//compare a with b for the relation cond, returns the relation to test the
+//flags for, mirrored when the operands had to be swapped
+static int compare(Location a, Location b, int cond) {
+  if (a.kind == LOC_CONSTANT && b.kind != LOC_CONSTANT) {
+    swap(a, b);
+    cond = mirror(cond);
+  }
+  if (a.kind == LOC_REGISTER || (a.kind == LOC_MEMORY && b.kind != LOC_MEMORY && fitsImmediate(b))) {
+    Compare(a.text, source(b));
+  } else {
+    move(registerLocation(PRIMARY), a);
+    Compare(PRIMARY, source(b));
+  }
+  return cond;
+}
+
+static bool commutes(int op) {
+  return op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR || op == IR_XOR;
+}
+
+//target = target op src, target is a register
+static void operate(int op, string target, const Location &src) {
+  switch (op) {
+  case IR_ADD:
+    Add(target, source(src));
+    break;
+  case IR_SUB:
+    Subtract(target, source(src));
+    break;
+  case IR_MUL:
+    Multiply(target, source(src));
+    break;
+  case IR_AND:
+    And(target, source(src));
+    break;
+  case IR_OR:
+    Or(target, source(src));
+    break;
+  case IR_XOR:
+    Xor(target, source(src));
+    break;
+  }
+}
+
+//dst = a op b, computed in the register of dst when it has one
+static void binary(int op, const Location &dst, Location a, Location b) {
+  Location primary = registerLocation(PRIMARY);
+  if (op == IR_DIV) {
+    move(primary, a);
+    if (b.kind == LOC_CONSTANT) {
+      Move(SCRATCH, operand(b));
+      Divide(SCRATCH);
+    } else {
+      Divide(b.text);
+    }
+    move(dst, primary);
+    return;
+  }
+  if (sameLocation(dst, b) && commutes(op))
+    swap(a, b);
+  Location target = dst.kind == LOC_REGISTER && !sameLocation(dst, b) ? dst : primary;
+  move(target, a);
+  operate(op, target.text, b);
+  move(dst, target);
+}
+
+//restore the callee saved registers and leave the function
+static void leave() {
+  if (fn->symbol < 0) {
+    epilog();
+    return;
+  }
+  for (size_t r = saved.size(); r > 0; r--)
+    Pop(saved[r - 1]);
+  subEpilog(slotCount);
+}
+
+static void instruction(int b, const IrInst &i) {
+  Location primary = registerLocation(PRIMARY);
+  switch (i.op) {
+  case IR_CONST:
+    break;
+  case IR_PARAM:
+    move(locations[i.dst], memoryLocation(paramSlot(i.imm)));
+    break;
+  case IR_LOAD:
+    move(locations[i.dst], memoryLocation(globalVar(identifierName(i.imm))));
+    break;
+  case IR_STORE:
+    move(memoryLocation(globalVar(identifierName(i.imm))), locations[i.a]);
+    break;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+  case IR_AND:
+  case IR_OR:
+  case IR_XOR:
+    binary(i.op, locations[i.dst], locations[i.a], locations[i.b]);
+    break;
+  case IR_NOT: {
+    const Location &dst = locations[i.dst];
+    Location target = dst.kind == LOC_REGISTER ? dst : primary;
+    move(target, locations[i.a]);
+    Not(target.text);
+    move(dst, target);
+    break;
+  }
+  case IR_CMP:
+    setRelation(compare(locations[i.a], locations[i.b], i.cond));
+    move(locations[i.dst], primary);
+    break;
+  case IR_ARG:
+    if (fitsImmediate(locations[i.a])) {
+      Push(operand(locations[i.a]));
+    } else {
+      move(primary, locations[i.a]);
+      Push(PRIMARY);
+    }
+    break;
+  case IR_CALL:
+    call(identifierName(i.imm));
+    cleanStack(8 * i.b);
+    break;
+  case IR_READ:
+    readIt();
+    move(locations[i.dst], primary);
+    break;
+  case IR_WRITE:
+    move(primary, locations[i.a]);
+    writeIt();
+    break;
+  case IR_JUMP:
+    phiCopies(b);
+    if (!isNext(b, fn->blocks[b].succs[0]))
+      branch(labels[fn->blocks[b].succs[0]]);
+    break;
+  case IR_BRANCH: {
+    // a plain value branches on being other than 0, a fused relation needs
+    // nothing but the cmp
+    const IrBlock &block = fn->blocks[b];
+    int cond;
+    if (i.cond == 0)
+      cond = compare(locations[i.a], constantLocation(0), OP_REL_NE);
+    else
+      cond = compare(locations[i.a], locations[i.b], i.cond);
+    if (isNext(b, block.succs[0])) {
+      branchRelation(invert(cond), labels[block.succs[1]]);
+    } else {
+      branchRelation(cond, labels[block.succs[0]]);
+      if (!isNext(b, block.succs[1]))
+        branch(labels[block.succs[1]]);
+    }
+    break;
+  }
+  case IR_RETURN:
+    leave();
+    break;
+  }
+}
+
+static void function(const IrFunction &f) {
+  fn = &f;
+  base = f.paramCount;
+  assignLabels();
+  assignLocations();
+  subProlog(f.symbol < 0 ? "main" : identifierName(f.symbol), slotCount);
+  if (f.symbol >= 0)
+    for (size_t r = 0; r < saved.size(); r++)
+      Push(saved[r]);
+  for (size_t i = 0; i < order.size(); i++) {
+    int b = order[i];
+    if (!labels[b].empty())
+      postLabel(labels[b]);
+    const IrBlock &block = f.blocks[b];
+    for (size_t i = 0; i < block.insts.size(); i++)
+      instruction(b, block.insts[i]);
+  }
+}
+
+void generate() {
+  TRACE(TRACE_LEVEL_PHASE, "generate()");
+  header();
+  for (size_t g = 0; g < irGlobals.size(); g++)
+    allocate(identifierName(irGlobals[g].symbol), irGlobals[g].value);
+  prolog();
+  runtime();
+  flushLines();
+  // the peephole rules look at one function at a time
+  for (size_t f = 0; f < irFunctions.size(); f++) {
+    function(irFunctions[f]);
+    flushLines();
+  }
+}
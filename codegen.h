@@ -0,0 +1,7 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+//translate irFunctions and irGlobals to assembly through the target emitters
+void generate();
+
+#endif // CODEGEN_H
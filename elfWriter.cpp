@@ -0,0 +1,288 @@
+#include "elfWriter.h"
+#include "assembler.h"
+#include "trace.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <stdint.h>
+
+#ifdef __linux
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+void abort(string);
+
+// the parts of the ELF64 format in use, spelled out so no system header
+// is needed to build on windows
+const int ELF_HEADER_SIZE     = 64;
+const int PROGRAM_HEADER_SIZE = 56;
+const int SECTION_HEADER_SIZE = 64;
+const int SYMBOL_SIZE         = 24;
+const int RELA_SIZE           = 24;
+
+const int ET_REL       = 1;
+const int ET_EXEC      = 2;
+const int EM_X86_64    = 62;
+
+const int PT_LOAD      = 1;
+const int PT_GNU_STACK = 0x6474E551;
+
+const int PF_X = 1;
+const int PF_W = 2;
+const int PF_R = 4;
+
+const int SHT_PROGBITS = 1;
+const int SHT_SYMTAB   = 2;
+const int SHT_STRTAB   = 3;
+const int SHT_RELA     = 4;
+const int SHT_NOBITS   = 8;
+
+const int SHF_WRITE     = 1;
+const int SHF_ALLOC     = 2;
+const int SHF_EXECINSTR = 4;
+const int SHF_INFO_LINK = 0x40;
+
+const int STB_LOCAL  = 0;
+const int STB_GLOBAL = 1;
+
+// section header indices of the object file
+enum {
+  INDEX_NULL, INDEX_TEXT, INDEX_DATA, INDEX_BSS, INDEX_SYMTAB, INDEX_STRTAB,
+  INDEX_RELA, INDEX_SHSTRTAB, INDEX_NOTE, INDEX_COUNT
+};
+
+static void put(vector<uint8_t> &out, uint64_t value, int bytes) {
+  for (int b = 0; b < bytes; b++)
+    out.push_back((uint8_t)(value >> (8 * b)));
+}
+
+static void align(vector<uint8_t> &out, size_t alignment) {
+  while (out.size() % alignment != 0)
+    out.push_back(0);
+}
+
+//add a name to a string table, returns its offset
+static uint32_t addString(vector<uint8_t> &table, const string &s) {
+  uint32_t offset = table.size();
+  table.insert(table.end(), s.begin(), s.end());
+  table.push_back(0);
+  return offset;
+}
+
+struct SectionHeader {
+  uint32_t name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t link;
+  uint32_t info;
+  uint64_t alignment;
+  uint64_t entrySize;
+};
+
+//the ELF header, what varies is the type and where things are
+static void elfHeader(vector<uint8_t> &out, int type, uint64_t entry, uint64_t programHeaders,
+                      int programHeaderCount, uint64_t sectionHeaders, int sectionCount, int names) {
+  static const uint8_t ident[16] = {0x7F, 'E', 'L', 'F', 2, 1, 1, 0};
+  out.insert(out.end(), ident, ident + 16);
+  put(out, type, 2);
+  put(out, EM_X86_64, 2);
+  put(out, 1, 4);                      // version
+  put(out, entry, 8);
+  put(out, programHeaders, 8);
+  put(out, sectionHeaders, 8);
+  put(out, 0, 4);                      // flags
+  put(out, ELF_HEADER_SIZE, 2);
+  put(out, programHeaderCount > 0 ? PROGRAM_HEADER_SIZE : 0, 2);
+  put(out, programHeaderCount, 2);
+  put(out, SECTION_HEADER_SIZE, 2);
+  put(out, sectionCount, 2);
+  put(out, names, 2);
+}
+
+static void programHeader(vector<uint8_t> &out, int type, int flags, uint64_t offset,
+                          uint64_t address, uint64_t fileSize, uint64_t memorySize, uint64_t alignment) {
+  put(out, type, 4);
+  put(out, flags, 4);
+  put(out, offset, 8);
+  put(out, address, 8);
+  put(out, address, 8);  // physical address
+  put(out, fileSize, 8);
+  put(out, memorySize, 8);
+  put(out, alignment, 8);
+}
+
+static bool writeFile(const string &fileName, const vector<uint8_t> &bytes) {
+  ofstream file(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+  if (!file)
+    return false;
+  file.write((const char *)&bytes[0], bytes.size());
+  metricsCount(COUNT_OUTPUT_BYTES, bytes.size());
+  return file.good();
+}
+
+vector<uint8_t> objectFileBytes() {
+  vector<SectionHeader> headers(INDEX_COUNT, SectionHeader());
+  vector<uint8_t> names;
+  names.push_back(0);
+  static const char *sectionNames[INDEX_COUNT] = {
+    "", ".text", ".data", ".bss", ".symtab", ".strtab", ".rela.text", ".shstrtab",
+    ".note.GNU-stack"
+  };
+  for (int s = 1; s < INDEX_COUNT; s++)
+    headers[s].name = addString(names, sectionNames[s]);
+
+  // locals have to come before globals, symbols get new numbers for that
+  vector<uint8_t> symbols(SYMBOL_SIZE, 0);
+  vector<uint8_t> strings;
+  strings.push_back(0);
+  vector<int> number(objectSymbols.size());
+  int next = 1;
+  for (int pass = 0; pass < 2; pass++) {
+    bool global = pass == 1;
+    if (global)
+      headers[INDEX_SYMTAB].info = next;
+    for (size_t s = 0; s < objectSymbols.size(); s++) {
+      const ObjectSymbol &o = objectSymbols[s];
+      if (o.global != global)
+        continue;
+      number[s] = next++;
+      static const int sectionIndex[3] = {INDEX_TEXT, INDEX_DATA, INDEX_BSS};
+      put(symbols, addString(strings, o.name), 4);
+      put(symbols, (global ? STB_GLOBAL : STB_LOCAL) << 4, 1);
+      put(symbols, 0, 1);
+      put(symbols, o.section == SECTION_UNDEFINED ? 0 : sectionIndex[o.section], 2);
+      put(symbols, o.value, 8);
+      put(symbols, 0, 8);
+    }
+  }
+
+  vector<uint8_t> relocations;
+  for (size_t r = 0; r < objectRelocations.size(); r++) {
+    const Relocation &o = objectRelocations[r];
+    put(relocations, o.offset, 8);
+    put(relocations, ((uint64_t)number[o.symbol] << 32) | o.type, 8);
+    put(relocations, o.addend, 8);
+  }
+
+  vector<uint8_t> out(ELF_HEADER_SIZE, 0);
+  struct Contents {
+    int index;
+    const vector<uint8_t> *bytes;
+    int alignment;
+  };
+  Contents contents[] = {
+    {INDEX_TEXT, &objectText, 16}, {INDEX_DATA, &objectData, 8},
+    {INDEX_SYMTAB, &symbols, 8}, {INDEX_STRTAB, &strings, 1},
+    {INDEX_RELA, &relocations, 8}, {INDEX_SHSTRTAB, &names, 1}
+  };
+  for (size_t c = 0; c < sizeof(contents) / sizeof(contents[0]); c++) {
+    align(out, contents[c].alignment);
+    SectionHeader &h = headers[contents[c].index];
+    h.offset = out.size();
+    h.size = contents[c].bytes->size();
+    h.alignment = contents[c].alignment;
+    out.insert(out.end(), contents[c].bytes->begin(), contents[c].bytes->end());
+  }
+  headers[INDEX_TEXT].type = SHT_PROGBITS;
+  headers[INDEX_TEXT].flags = SHF_ALLOC | SHF_EXECINSTR;
+  headers[INDEX_DATA].type = SHT_PROGBITS;
+  headers[INDEX_DATA].flags = SHF_ALLOC | SHF_WRITE;
+  headers[INDEX_BSS].type = SHT_NOBITS;
+  headers[INDEX_BSS].flags = SHF_ALLOC | SHF_WRITE;
+  headers[INDEX_BSS].offset = headers[INDEX_DATA].offset + headers[INDEX_DATA].size;
+  headers[INDEX_BSS].size = objectBssSize;
+  headers[INDEX_BSS].alignment = 16;
+  headers[INDEX_SYMTAB].type = SHT_SYMTAB;
+  headers[INDEX_SYMTAB].link = INDEX_STRTAB;
+  headers[INDEX_SYMTAB].entrySize = SYMBOL_SIZE;
+  headers[INDEX_STRTAB].type = SHT_STRTAB;
+  headers[INDEX_RELA].type = SHT_RELA;
+  headers[INDEX_RELA].flags = SHF_INFO_LINK;
+  headers[INDEX_RELA].link = INDEX_SYMTAB;
+  headers[INDEX_RELA].info = INDEX_TEXT;
+  headers[INDEX_RELA].entrySize = RELA_SIZE;
+  headers[INDEX_SHSTRTAB].type = SHT_STRTAB;
+  headers[INDEX_NOTE].type = SHT_PROGBITS;
+  headers[INDEX_NOTE].offset = out.size();
+  headers[INDEX_NOTE].alignment = 1;
+
+  align(out, 8);
+  uint64_t sectionHeaders = out.size();
+  for (int s = 0; s < INDEX_COUNT; s++) {
+    const SectionHeader &h = headers[s];
+    put(out, h.name, 4);
+    put(out, h.type, 4);
+    put(out, h.flags, 8);
+    put(out, 0, 8);  // address
+    put(out, h.offset, 8);
+    put(out, h.size, 8);
+    put(out, h.link, 4);
+    put(out, h.info, 4);
+    put(out, h.alignment, 8);
+    put(out, h.entrySize, 8);
+  }
+  vector<uint8_t> header;
+  elfHeader(header, ET_REL, 0, 0, 0, sectionHeaders, INDEX_COUNT, INDEX_SHSTRTAB);
+  copy(header.begin(), header.end(), out.begin());
+  return out;
+}
+
+bool writeObjectFile(string fileName) {
+  TRACE(TRACE_LEVEL_PHASE, "writeObjectFile(%s)", fileName);
+  return writeFile(fileName, objectFileBytes());
+}
+
+// where the executable is loaded, the code uses 32 bit absolute addresses
+// so it has to stay below 2GB
+const uint64_t IMAGE_BASE = 0x400000;
+const uint64_t PAGE_SIZE  = 0x1000;
+
+static uint64_t roundUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool writeExecutable(string fileName) {
+  TRACE(TRACE_LEVEL_PHASE, "writeExecutable(%s)", fileName);
+  // one read/execute segment with the headers and .text, one read/write
+  // segment with .data followed by .bss
+  const int programHeaderCount = 3;
+  uint64_t textOffset = roundUp(ELF_HEADER_SIZE + programHeaderCount * PROGRAM_HEADER_SIZE, 16);
+  uint64_t dataOffset = roundUp(textOffset + objectText.size(), PAGE_SIZE);
+  uint64_t bssStart = roundUp(objectData.size(), 16);
+  uint64_t sectionAddress[3] = {
+    IMAGE_BASE + textOffset, IMAGE_BASE + dataOffset, IMAGE_BASE + dataOffset + bssStart
+  };
+
+  uint64_t entry = 0;
+  for (size_t s = 0; s < objectSymbols.size(); s++)
+    if (objectSymbols[s].name == "main" && objectSymbols[s].section == SECTION_TEXT)
+      entry = sectionAddress[SECTION_TEXT] + objectSymbols[s].value;
+  if (entry == 0)
+    abort("no main to start the executable at");
+
+  vector<uint8_t> out;
+  elfHeader(out, ET_EXEC, entry, ELF_HEADER_SIZE, programHeaderCount, 0, 0, 0);
+  programHeader(out, PT_LOAD, PF_R | PF_X, 0, IMAGE_BASE,
+                textOffset + objectText.size(), textOffset + objectText.size(), PAGE_SIZE);
+  programHeader(out, PT_LOAD, PF_R | PF_W, dataOffset, sectionAddress[SECTION_DATA],
+                objectData.size(), bssStart + objectBssSize, PAGE_SIZE);
+  programHeader(out, PT_GNU_STACK, PF_R | PF_W, 0, 0, 0, 0, 16);
+  out.resize(textOffset, 0);
+  vector<uint8_t> text = relocatedText(sectionAddress);
+  out.insert(out.end(), text.begin(), text.end());
+  out.resize(dataOffset, 0);
+  out.insert(out.end(), objectData.begin(), objectData.end());
+
+  if (!writeFile(fileName, out))
+    return false;
+#ifdef __linux
+  chmod(fileName.c_str(), 0755);
+#endif
+  return true;
+}
@@ -0,0 +1,28 @@
+#ifndef ELF_WRITER_H
+#define ELF_WRITER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// the assembled program written out as an ELF64 file for x86-64 linux
+//
+// the object file holds .text, .data and .bss as they came out of
+// finishAssembly, a symbol table with the locals first and a .rela.text
+// for the references the assembler couldn't resolve. An empty
+// .note.GNU-stack section marks the stack as not executable.
+//
+// the executable is linked statically at 0x400000, with no C runtime and no
+// dynamic loader. The program starts at main and leaves with the exit
+// syscall, so it must not refer to anything outside itself.
+
+//the bytes of the relocatable object
+std::vector<uint8_t> objectFileBytes();
+
+//write the relocatable object, false if the file can't be written
+bool writeObjectFile(std::string fileName);
+
+//link the program into an executable, false if the file can't be written
+bool writeExecutable(std::string fileName);
+
+#endif // ELF_WRITER_H
@@ -0,0 +1,46 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <stdint.h>
+
+#include "tokens.h"
+
+// compile time evaluation of operators, shared by the parser for constant
+// declarations and by the IR constant propagation. Results match what the
+// generated code computes: 64 bit two's complement arithmetic that wraps,
+// division truncating toward zero and relations giving 1 or 0
+
+//result of a op b for an OP_* operator or relation, false if the result
+//is only known at run time (division by zero or the one overflowing divide)
+inline bool foldOperator(int op, int64_t a, int64_t b, int64_t &result) {
+  uint64_t ua = (uint64_t)a;
+  uint64_t ub = (uint64_t)b;
+  switch (op) {
+  case OP_ADD:    result = (int64_t)(ua + ub); return true;
+  case OP_SUB:    result = (int64_t)(ua - ub); return true;
+  case OP_MULT:   result = (int64_t)(ua * ub); return true;
+  case OP_REL_A:  result = a & b; return true;
+  case OP_OR:     result = a | b; return true;
+  case OP_XOR:    result = a ^ b; return true;
+  case OP_DIV:
+    if (b == 0 || (a == INT64_MIN && b == -1))
+      return false;
+    result = a / b;
+    return true;
+  case OP_REL_E:  result = a == b; return true;
+  case OP_REL_NE: result = a != b; return true;
+  case OP_REL_L:  result = a < b; return true;
+  case OP_REL_G:  result = a > b; return true;
+  case OP_REL_LE: result = a <= b; return true;
+  case OP_REL_GE: result = a >= b; return true;
+  default:
+    return false;
+  }
+}
+
+//result of the complement the not operator compiles to
+inline int64_t foldNot(int64_t a) {
+  return ~a;
+}
+
+#endif // FOLD_H
@@ -0,0 +1,62 @@
+#include "identifiers.h"
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// names indexed by id
+static thread_local vector<string> names;
+
+// open addressed hash table of ids, -1 marks an empty slot
+static thread_local vector<int> slots(64, -1);
+
+static uint32_t hashName(const string &name) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (size_t i = 0; i < name.length(); i++) {
+    h ^= (unsigned char)name[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+//slot holding name, or the empty slot where it belongs
+static size_t findSlot(const string &name) {
+  size_t mask = slots.size() - 1;
+  size_t i = hashName(name) & mask;
+  while (slots[i] != -1 && names[slots[i]] != name)
+    i = (i + 1) & mask;
+  return i;
+}
+
+//double the table once it is half full
+static void grow() {
+  slots.assign(slots.size() * 2, -1);
+  for (size_t id = 0; id < names.size(); id++)
+    slots[findSlot(names[id])] = id;
+}
+
+int intern(const string &name) {
+  size_t i = findSlot(name);
+  if (slots[i] != -1)
+    return slots[i];
+  int id = names.size();
+  names.push_back(name);
+  slots[i] = id;
+  if (names.size() * 2 > slots.size())
+    grow();
+  return id;
+}
+
+const string &identifierName(int id) {
+  return names[id];
+}
+
+int identifierCount() {
+  return names.size();
+}
+
+void clearIdentifiers() {
+  names.clear();
+  slots.assign(64, -1);
+}
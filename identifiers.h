@@ -0,0 +1,18 @@
+#ifndef IDENTIFIERS_H
+#define IDENTIFIERS_H
+
+#include <string>
+
+//intern an identifier, returning its dense id
+int intern(const std::string &name);
+
+//name of an interned identifier
+const std::string &identifierName(int id);
+
+//number of identifiers interned so far, ids run from 0 to count-1
+int identifierCount();
+
+//forget every interned identifier
+void clearIdentifiers();
+
+#endif // IDENTIFIERS_H
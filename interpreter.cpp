@@ -0,0 +1,212 @@
+#include "bytecode.h"
+#include "trace.h"
+
+#include <cstring>
+#include <stdlib.h>
+#include <string>
+
+#ifdef __linux
+#include <unistd.h>
+#else
+#include <io.h>
+#define read _read
+#define write _write
+#endif
+
+using namespace std;
+
+void abort(string);
+
+// frames of all active calls, a call past the end is a stack overflow like
+// it would be for the native program. The stack comes from calloc, whose
+// pages aren't touched until a frame is, so a short run doesn't pay for
+// all of it
+static const size_t STACK_SLOTS = 1 << 20;
+
+// the program's buffered standard input and output, kept by interpret()
+// so every run, on whatever thread, has its own
+static const int BUFFER_SIZE = 65536;
+
+struct Streams {
+  char output[BUFFER_SIZE];
+  int outputLength;
+  char input[BUFFER_SIZE];
+  int inputPosition;
+  int inputLength;
+  bool inputDone;
+};
+
+static void flushOutput(Streams &io) {
+  int done = 0;
+  while (done < io.outputLength) {
+    int n = write(1, io.output + done, io.outputLength - done);
+    if (n <= 0)
+      break;
+    done += n;
+  }
+  io.outputLength = 0;
+}
+
+//next byte of standard input without taking it, -1 at the end
+static int peekInput(Streams &io) {
+  if (io.inputPosition == io.inputLength) {
+    if (io.inputDone)
+      return -1;
+    io.inputPosition = 0;
+    io.inputLength = read(0, io.input, BUFFER_SIZE);
+    if (io.inputLength <= 0) {
+      io.inputLength = 0;
+      io.inputDone = true;
+      return -1;
+    }
+  }
+  return (unsigned char)io.input[io.inputPosition];
+}
+
+static bool isDigit(int c) {
+  return c >= '0' && c <= '9';
+}
+
+//the next integer on standard input, read like the native read_integer: up
+//to a digit or '-', which may start it, 0 at the end of the input
+static int64_t readInteger(Streams &io) {
+  flushOutput(io);
+  int c = peekInput(io);
+  while (c != -1 && c != '-' && !isDigit(c)) {
+    io.inputPosition++;
+    c = peekInput(io);
+  }
+  if (c == -1)
+    return 0;
+  bool negative = c == '-';
+  if (negative) {
+    io.inputPosition++;
+    c = peekInput(io);
+  }
+  uint64_t value = 0;
+  while (isDigit(c)) {
+    value = value * 10 + (c - '0');
+    io.inputPosition++;
+    c = peekInput(io);
+  }
+  return negative ? 0 - value : value;
+}
+
+struct Return {
+  const int32_t *pc;
+  int64_t *frame;
+};
+
+void interpret() {
+  TRACE(TRACE_LEVEL_PHASE, "interpret()");
+  // each opcode word is replaced by the distance of its handler from the
+  // first one, dispatch is then a jump through the word itself
+#define H(name) (int)((char *)&&op_##name - (char *)&&op_MOVE)
+  static const int handlers[BC_OP_COUNT] = {
+    H(MOVE), H(ADD), H(SUB), H(MUL), H(DIV), H(AND), H(OR), H(XOR), H(NOT),
+    H(EQ), H(NE), H(LT), H(GT), H(LE), H(GE), H(LOAD), H(STORE), H(JUMP),
+    H(JUMP_EQ), H(JUMP_NE), H(JUMP_LT), H(JUMP_GT), H(JUMP_LE), H(JUMP_GE),
+    H(JUMP_Z), H(JUMP_NZ), H(CALL), H(READ), H(WRITE), H(RETURN)
+  };
+#undef H
+  vector<int32_t> code(bytecode);
+  for (size_t k = 0; k < bytecodeOps.size(); k++)
+    code[bytecodeOps[k]] = handlers[code[bytecodeOps[k]]];
+
+  vector<int64_t> globals(bytecodeGlobals);
+  vector<Return> returns;
+  const BytecodeFunction &program = bytecodeFunctions[0];
+  if (program.frame.size() > STACK_SLOTS)
+    abort("stack overflow");
+  int64_t *stack = (int64_t *)calloc(STACK_SLOTS, sizeof(int64_t));
+  if (stack == NULL)
+    abort("out of memory for the stack");
+  memcpy(stack, &program.frame[0], program.frame.size() * sizeof(int64_t));
+  int64_t *frame = stack;
+  int64_t *stackEnd = stack + STACK_SLOTS;
+  int64_t *g = globals.empty() ? NULL : &globals[0];
+  const int32_t *start = &code[0];
+  const int32_t *pc = start + program.entry;
+  Streams io;
+  io.outputLength = 0;
+  io.inputPosition = io.inputLength = 0;
+  io.inputDone = false;
+
+// slots are read through unsigned so overflow wraps like the machine does
+#define S(n) frame[pc[n]]
+#define U(n) ((uint64_t)frame[pc[n]])
+#define NEXT(words) do { pc += words; goto *(void *)((char *)&&op_MOVE + *pc); } while (0)
+#define BINARY(name, expression) \
+  op_##name: S(1) = (int64_t)(expression); NEXT(4)
+#define JUMP_IF(name, relation) \
+  op_##name: if (S(1) relation S(2)) { pc = start + pc[3]; NEXT(0); } NEXT(4)
+
+  NEXT(0);
+  op_MOVE: S(1) = S(2); NEXT(3);
+  BINARY(ADD, U(2) + U(3));
+  BINARY(SUB, U(2) - U(3));
+  BINARY(MUL, U(2) * U(3));
+  op_DIV:
+    if (S(3) == 0)
+      abort("division by zero");
+    S(1) = S(3) == -1 ? (int64_t)(0 - U(2)) : S(2) / S(3);
+    NEXT(4);
+  BINARY(AND, U(2) & U(3));
+  BINARY(OR, U(2) | U(3));
+  BINARY(XOR, U(2) ^ U(3));
+  op_NOT: S(1) = ~S(2); NEXT(3);
+  BINARY(EQ, S(2) == S(3));
+  BINARY(NE, S(2) != S(3));
+  BINARY(LT, S(2) < S(3));
+  BINARY(GT, S(2) > S(3));
+  BINARY(LE, S(2) <= S(3));
+  BINARY(GE, S(2) >= S(3));
+  op_LOAD: S(1) = g[pc[2]]; NEXT(3);
+  op_STORE: g[pc[1]] = S(2); NEXT(3);
+  op_JUMP: pc = start + pc[1]; NEXT(0);
+  JUMP_IF(JUMP_EQ, ==);
+  JUMP_IF(JUMP_NE, !=);
+  JUMP_IF(JUMP_LT, <);
+  JUMP_IF(JUMP_GT, >);
+  JUMP_IF(JUMP_LE, <=);
+  JUMP_IF(JUMP_GE, >=);
+  op_JUMP_Z: if (S(1) == 0) { pc = start + pc[2]; NEXT(0); } NEXT(3);
+  op_JUMP_NZ: if (S(1) != 0) { pc = start + pc[2]; NEXT(0); } NEXT(3);
+  op_CALL: {
+    const BytecodeFunction &callee = bytecodeFunctions[pc[1]];
+    int64_t *next = frame + pc[2];
+    if (callee.frame.size() > (size_t)(stackEnd - next))
+      abort("stack overflow");
+    memcpy(next, &callee.frame[0], callee.frame.size() * sizeof(int64_t));
+    int count = pc[3];
+    for (int a = 0; a < count; a++)
+      next[a] = frame[pc[4 + a]];
+    Return r = {pc + 4 + count, frame};
+    returns.push_back(r);
+    frame = next;
+    pc = start + callee.entry;
+    NEXT(0);
+  }
+  op_READ: S(1) = readInteger(io); NEXT(2);
+  op_WRITE:
+    io.output[io.outputLength++] = (char)S(1);
+    if (io.outputLength == BUFFER_SIZE)
+      flushOutput(io);
+    NEXT(2);
+  op_RETURN:
+    if (returns.empty()) {
+      flushOutput(io);
+      free(stack);
+      return;
+    }
+    pc = returns.back().pc;
+    frame = returns.back().frame;
+    returns.pop_back();
+    NEXT(0);
+
+#undef S
+#undef U
+#undef NEXT
+#undef BINARY
+#undef JUMP_IF
+}
@@ -0,0 +1,185 @@
+#include "ir.h"
+#include "tokens.h"
+#include "identifiers.h"
+
+#include <stdio.h>
+
+using namespace std;
+
+thread_local vector<IrFunction> irFunctions;
+thread_local vector<IrGlobal> irGlobals;
+
+bool endsBlock(const IrInst &i) {
+  return i.op == IR_JUMP || i.op == IR_BRANCH || i.op == IR_RETURN;
+}
+
+int operandCount(const IrInst &i) {
+  switch (i.op) {
+  case IR_STORE:
+  case IR_NOT:
+  case IR_ARG:
+  case IR_WRITE:
+    return 1;
+  case IR_BRANCH:
+    return i.cond != 0 ? 2 : 1;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+  case IR_AND:
+  case IR_OR:
+  case IR_XOR:
+  case IR_CMP:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+vector<int> blockOrder(const IrFunction &f) {
+  vector<int> postorder;
+  vector<char> visited(f.blocks.size(), false);
+  vector<pair<int,int> > stack; // block and how many successors are done
+  stack.push_back(make_pair(0, 0));
+  visited[0] = true;
+  while (!stack.empty()) {
+    int b = stack.back().first;
+    const vector<int> &succs = f.blocks[b].succs;
+    int done = stack.back().second;
+    if (done == (int)succs.size()) {
+      postorder.push_back(b);
+      stack.pop_back();
+      continue;
+    }
+    stack.back().second++;
+    // last successor first, so the first one ends up next in reverse
+    int s = succs[succs.size() - 1 - done];
+    if (!visited[s]) {
+      visited[s] = true;
+      stack.push_back(make_pair(s, 0));
+    }
+  }
+  return vector<int>(postorder.rbegin(), postorder.rend());
+}
+
+void splitCriticalEdges(IrFunction &f) {
+  int blockCount = f.blocks.size();
+  for (int b = 0; b < blockCount; b++) {
+    for (size_t k = 0; k < f.blocks[b].succs.size(); k++) {
+      int s = f.blocks[b].succs[k];
+      if (f.blocks[b].succs.size() < 2 || f.blocks[s].phis.empty())
+        continue;
+      int n = f.blocks.size();
+      IrBlock edge;
+      IrInst jump = IrInst();
+      jump.op = IR_JUMP;
+      jump.dst = NO_VALUE;
+      edge.insts.push_back(jump);
+      edge.preds.push_back(b);
+      edge.succs.push_back(s);
+      f.blocks.push_back(edge);
+      f.blocks[b].succs[k] = n;
+      vector<int> &preds = f.blocks[s].preds;
+      for (size_t p = 0; p < preds.size(); p++) {
+        if (preds[p] == b) {
+          preds[p] = n;
+          break;
+        }
+      }
+    }
+  }
+}
+
+static const char *opNames[] = {
+  "const", "param", "load", "store", "add", "sub", "mul", "div", "and",
+  "or", "xor", "not", "cmp", "arg", "call", "read", "write", "jump",
+  "branch", "return"
+};
+
+//name of a relation in a compare
+static const char *relationName(int cond) {
+  switch (cond) {
+  case OP_REL_E:  return "=";
+  case OP_REL_NE: return "<>";
+  case OP_REL_L:  return "<";
+  case OP_REL_G:  return ">";
+  case OP_REL_LE: return "<=";
+  case OP_REL_GE: return ">=";
+  default:        return "?";
+  }
+}
+
+static void dumpInst(const IrInst &i) {
+  printf("    ");
+  if (i.dst != NO_VALUE)
+    printf("v%d = ", i.dst);
+  printf("%s", opNames[i.op]);
+  switch (i.op) {
+  case IR_CONST:
+  case IR_PARAM:
+    printf(" %lld", (long long)i.imm);
+    break;
+  case IR_LOAD:
+    printf(" %s", identifierName(i.imm).c_str());
+    break;
+  case IR_STORE:
+    printf(" %s, v%d", identifierName(i.imm).c_str(), i.a);
+    break;
+  case IR_NOT:
+  case IR_ARG:
+  case IR_WRITE:
+    printf(" v%d", i.a);
+    break;
+  case IR_BRANCH:
+    if (i.cond == 0)
+      printf(" v%d", i.a);
+    else
+      printf(" v%d %s v%d", i.a, relationName(i.cond), i.b);
+    break;
+  case IR_CMP:
+    printf(" v%d %s v%d", i.a, relationName(i.cond), i.b);
+    break;
+  case IR_CALL:
+    printf(" %s, %d", identifierName(i.imm).c_str(), i.b);
+    break;
+  case IR_JUMP:
+  case IR_RETURN:
+    break;
+  default:
+    printf(" v%d, v%d", i.a, i.b);
+  }
+  printf("\n");
+}
+
+void dumpIr() {
+  for (size_t f = 0; f < irFunctions.size(); f++) {
+    const IrFunction &fn = irFunctions[f];
+    printf("::%s (%d params, %d values)\n",
+           fn.symbol < 0 ? "main" : identifierName(fn.symbol).c_str(),
+           fn.paramCount, fn.valueCount);
+    for (size_t b = 0; b < fn.blocks.size(); b++) {
+      const IrBlock &block = fn.blocks[b];
+      printf("  b%d:", (int)b);
+      if (!block.preds.empty()) {
+        printf("  ; preds");
+        for (size_t p = 0; p < block.preds.size(); p++)
+          printf(" b%d", block.preds[p]);
+      }
+      printf("\n");
+      for (size_t p = 0; p < block.phis.size(); p++) {
+        printf("    v%d = phi", block.phis[p].dst);
+        for (size_t a = 0; a < block.phis[p].args.size(); a++)
+          printf(" v%d", block.phis[p].args[a]);
+        printf("\n");
+      }
+      for (size_t i = 0; i < block.insts.size(); i++)
+        dumpInst(block.insts[i]);
+      if (!block.succs.empty()) {
+        printf("    ->");
+        for (size_t s = 0; s < block.succs.size(); s++)
+          printf(" b%d", block.succs[s]);
+        printf("\n");
+      }
+    }
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef IR_H
+#define IR_H
+
+#include <vector>
+#include <stdint.h>
+
+// three address intermediate representation in SSA form
+//
+// the main program and every subroutine become an IrFunction, a list of
+// basic blocks joined by explicit predecessor and successor edges with
+// block 0 as the entry. Values are numbered per function and each one is
+// defined exactly once, either by an instruction or by a phi at the head
+// of a block. Globals stay in memory and are reached with IR_LOAD and
+// IR_STORE, parameters and locals of a subroutine are SSA values.
+
+const int NO_VALUE = -1;
+
+enum IrOp {
+  IR_CONST,   // dst = imm
+  IR_PARAM,   // dst = incoming argument, imm = parameter number
+  IR_LOAD,    // dst = global, imm = identifier id
+  IR_STORE,   // global = a, imm = identifier id
+  IR_ADD,     // dst = a + b
+  IR_SUB,     // dst = a - b
+  IR_MUL,     // dst = a * b
+  IR_DIV,     // dst = a / b
+  IR_AND,     // dst = a & b
+  IR_OR,      // dst = a | b
+  IR_XOR,     // dst = a ^ b
+  IR_NOT,     // dst = ~a
+  IR_CMP,     // dst = 1 if a cond b else 0, cond = OP_REL_*
+  IR_ARG,     // pass a as the next argument of the following IR_CALL
+  IR_CALL,    // call subroutine imm with b arguments
+  IR_READ,    // dst = next integer on standard input
+  IR_WRITE,   // write a
+  IR_JUMP,    // terminator, continue at succs[0]
+  IR_BRANCH,  // terminator, succs[0] if a is not 0 else succs[1], or
+              //   with cond set succs[0] if a cond b else succs[1]
+  IR_RETURN   // terminator, leave the function
+};
+
+struct IrInst {
+  uint8_t op;
+  int16_t cond;     // OP_REL_* for IR_CMP and a fused IR_BRANCH, else 0
+  int dst;
+  int a, b;
+  int64_t imm;
+};
+
+struct IrPhi {
+  int dst;
+  int var;                // parameter number of the variable merged
+  std::vector<int> args;  // incoming value for each entry of preds
+};
+
+struct IrBlock {
+  std::vector<IrPhi> phis;
+  std::vector<IrInst> insts;  // ends with exactly one terminator
+  std::vector<int> preds;
+  std::vector<int> succs;
+};
+
+struct IrFunction {
+  int symbol;       // identifier id, -1 for the main program
+  int paramCount;   // formal parameters
+  int valueCount;
+  std::vector<IrBlock> blocks;
+};
+
+struct IrGlobal {
+  int symbol;
+  int64_t value;    // initial value
+};
+
+// main program first, then subroutines in source order
+extern thread_local std::vector<IrFunction> irFunctions;
+extern thread_local std::vector<IrGlobal> irGlobals;
+
+//translate a program tree into irFunctions and irGlobals
+void buildIr(int program);
+
+//fold and propagate constants through irFunctions, remove the branches
+//that can't be taken and the code whose results are never used
+void optimizeIr();
+
+//true for instructions that end a block
+bool endsBlock(const IrInst &i);
+
+//number of value operands an instruction reads, a first then b
+int operandCount(const IrInst &i);
+
+//blocks in reverse postorder, the first successor of a block placed right
+//after it whenever possible so branches can fall through
+std::vector<int> blockOrder(const IrFunction &f);
+
+//split edges from a block with several successors to one with phis
+void splitCriticalEdges(IrFunction &f);
+
+//print every function to stdout
+void dumpIr();
+
+#endif // IR_H
@@ -0,0 +1,429 @@
+#include "ir.h"
+#include "ast.h"
+#include "tokens.h"
+#include "trace.h"
+
+using namespace std;
+
+// SSA construction follows Braun et al, "Simple and Efficient Construction
+// of Static Single Assignment Form": variables are looked up on demand,
+// phis are placed at joins and trivial phis are folded away as they appear
+
+static thread_local IrFunction *fn;  // function being built
+static thread_local int current;     // block new instructions go to
+
+static thread_local vector<vector<int> > currentDef;   // value of each variable per block
+static thread_local vector<char> sealed;               // every predecessor is known
+static thread_local vector<vector<int> > incomplete;   // phis waiting for a block to seal
+static thread_local vector<int> alias;                 // what each removed phi became
+static thread_local vector<int> pendingSubs;           // subroutines still to translate
+
+static void statements(int n);
+
+static int newValue() {
+  alias.push_back(fn->valueCount);
+  return fn->valueCount++;
+}
+
+//follow removed phis to the value that replaced them
+static int resolve(int v) {
+  while (alias[v] != v)
+    v = alias[v];
+  return v;
+}
+
+static int newBlock() {
+  fn->blocks.push_back(IrBlock());
+  sealed.push_back(false);
+  incomplete.push_back(vector<int>());
+  for (size_t v = 0; v < currentDef.size(); v++)
+    currentDef[v].push_back(NO_VALUE);
+  return fn->blocks.size() - 1;
+}
+
+static void addEdge(int from, int to) {
+  fn->blocks[from].succs.push_back(to);
+  fn->blocks[to].preds.push_back(from);
+}
+
+//append an instruction to the current block, returns the value it defines
+static int emit(int op, int a, int b, int64_t imm, int cond = 0) {
+  IrInst i = IrInst();
+  i.op = op;
+  i.cond = cond;
+  i.dst = NO_VALUE;
+  i.a = a;
+  i.b = b;
+  i.imm = imm;
+  switch (op) {
+  case IR_STORE:
+  case IR_ARG:
+  case IR_CALL:
+  case IR_WRITE:
+  case IR_JUMP:
+  case IR_BRANCH:
+  case IR_RETURN:
+    break;
+  default:
+    i.dst = newValue();
+  }
+  fn->blocks[current].insts.push_back(i);
+  return i.dst;
+}
+
+static void jump(int to) {
+  emit(IR_JUMP, NO_VALUE, NO_VALUE, 0);
+  addEdge(current, to);
+}
+
+static void branch(int condition, int ifTrue, int ifFalse) {
+  emit(IR_BRANCH, condition, NO_VALUE, 0);
+  addEdge(current, ifTrue);
+  addEdge(current, ifFalse);
+}
+
+//branch on a cond b without computing its 0 or 1 first
+static void branchCompare(int cond, int a, int b, int ifTrue, int ifFalse) {
+  emit(IR_BRANCH, a, b, 0, cond);
+  addEdge(current, ifTrue);
+  addEdge(current, ifFalse);
+}
+
+static void writeVariable(int var, int block, int value) {
+  currentDef[var][block] = value;
+}
+
+static int readVariable(int var, int block);
+
+//drop a phi whose operands are all one value, returns what it stands for
+static int tryRemoveTrivialPhi(int block, int p) {
+  IrPhi &phi = fn->blocks[block].phis[p];
+  int same = NO_VALUE;
+  for (size_t i = 0; i < phi.args.size(); i++) {
+    int a = resolve(phi.args[i]);
+    if (a == same || a == phi.dst)
+      continue;
+    if (same != NO_VALUE)
+      return phi.dst;
+    same = a;
+  }
+  if (same == NO_VALUE)
+    return phi.dst;
+  alias[phi.dst] = same;
+  return same;
+}
+
+static int addPhiOperands(int block, int p) {
+  int var = fn->blocks[block].phis[p].var;
+  for (size_t i = 0; i < fn->blocks[block].preds.size(); i++) {
+    int a = readVariable(var, fn->blocks[block].preds[i]);
+    fn->blocks[block].phis[p].args.push_back(a);
+  }
+  return tryRemoveTrivialPhi(block, p);
+}
+
+static int newPhi(int block, int var) {
+  IrPhi phi;
+  phi.dst = newValue();
+  phi.var = var;
+  fn->blocks[block].phis.push_back(phi);
+  return fn->blocks[block].phis.size() - 1;
+}
+
+static int readVariableRecursive(int var, int block) {
+  int v;
+  if (!sealed[block]) {
+    int p = newPhi(block, var);
+    incomplete[block].push_back(p);
+    v = fn->blocks[block].phis[p].dst;
+  } else if (fn->blocks[block].preds.size() == 1) {
+    v = readVariable(var, fn->blocks[block].preds[0]);
+  } else {
+    int p = newPhi(block, var);
+    writeVariable(var, block, fn->blocks[block].phis[p].dst);
+    v = addPhiOperands(block, p);
+  }
+  writeVariable(var, block, v);
+  return v;
+}
+
+static int readVariable(int var, int block) {
+  if (currentDef[var][block] != NO_VALUE)
+    return resolve(currentDef[var][block]);
+  return readVariableRecursive(var, block);
+}
+
+//every predecessor of block is known, finish its phis
+static void sealBlock(int block) {
+  for (size_t i = 0; i < incomplete[block].size(); i++)
+    addPhiOperands(block, incomplete[block][i]);
+  incomplete[block].clear();
+  sealed[block] = true;
+}
+
+static int binaryOp(int op) {
+  switch (op) {
+  case OP_ADD:    return IR_ADD;
+  case OP_SUB:    return IR_SUB;
+  case OP_MULT:   return IR_MUL;
+  case OP_DIV:    return IR_DIV;
+  case OP_REL_A:  return IR_AND;
+  case OP_OR:     return IR_OR;
+  default:        return IR_XOR;
+  }
+}
+
+//lower an expression, operands are computed left to right
+static int expression(int n) {
+  static thread_local vector<int> order;
+  static thread_local vector<int> values;  // operands not yet used
+  postOrder(n, order);
+  values.clear();
+  for (size_t i = 0; i < order.size(); i++) {
+    const Node &e = nodes[order[i]];
+    int a, b;
+    switch (e.kind) {
+    case NODE_CONST:
+      values.push_back(emit(IR_CONST, NO_VALUE, NO_VALUE, e.value));
+      break;
+    case NODE_VAR:
+      values.push_back(emit(IR_LOAD, NO_VALUE, NO_VALUE, e.value));
+      break;
+    case NODE_PARAM:
+      values.push_back(readVariable(e.value, current));
+      break;
+    case NODE_NOT:
+      values.back() = emit(IR_NOT, values.back(), NO_VALUE, 0);
+      break;
+    case NODE_BINARY:
+    case NODE_COMPARE:
+      b = values.back();
+      values.pop_back();
+      a = values.back();
+      if (e.kind == NODE_COMPARE)
+        values.back() = emit(IR_CMP, a, b, 0, e.op);
+      else
+        values.back() = emit(binaryOp(e.op), a, b, 0);
+      break;
+    }
+  }
+  return values.back();
+}
+
+// set for the nodes of the condition being lowered that can only be 0 or 1,
+// a relation or relations joined by & and |
+static thread_local vector<char> isRelation;
+
+static void markRelations(int n) {
+  static thread_local vector<int> order;
+  postOrder(n, order);
+  isRelation.resize(nodeCount());
+  for (size_t i = 0; i < order.size(); i++) {
+    const Node &e = nodes[order[i]];
+    isRelation[order[i]] = e.kind == NODE_COMPARE ||
+      (e.kind == NODE_BINARY && (e.op == OP_REL_A || e.op == OP_OR) && isRelation[e.a] && isRelation[e.b]);
+  }
+}
+
+// part of a condition still to branch on, or with n NO_NODE the block
+// ifTrue that the branches so far lead to, to be sealed and carried on in
+struct PendingCondition {
+  int n;
+  int ifTrue;
+  int ifFalse;
+};
+
+//branch to ifTrue or ifFalse on a condition. Relations compare and branch
+//in one go, & and | of relations skip the right side once the left one
+//decides, which is safe as expressions have no side effects
+static void condition(int n, int ifTrue, int ifFalse) {
+  markRelations(n);
+  vector<PendingCondition> work;
+  PendingCondition first = {n, ifTrue, ifFalse};
+  work.push_back(first);
+  while (!work.empty()) {
+    PendingCondition c = work.back();
+    work.pop_back();
+    if (c.n == NO_NODE) {
+      sealBlock(c.ifTrue);
+      current = c.ifTrue;
+      continue;
+    }
+    const Node e = nodes[c.n];
+    if (e.kind == NODE_COMPARE) {
+      int a = expression(e.a);
+      int b = expression(e.b);
+      branchCompare(e.op, a, b, c.ifTrue, c.ifFalse);
+    } else if (isRelation[c.n]) {
+      // left side, then on to the right one in a block of its own
+      int right = newBlock();
+      PendingCondition rightSide = {e.b, c.ifTrue, c.ifFalse};
+      PendingCondition enter = {NO_NODE, right, NO_VALUE};
+      PendingCondition leftSide = {e.a, right, c.ifFalse};
+      if (e.op == OP_OR) {
+        leftSide.ifTrue = c.ifTrue;
+        leftSide.ifFalse = right;
+      }
+      work.push_back(rightSide);
+      work.push_back(enter);
+      work.push_back(leftSide);
+    } else {
+      branch(expression(c.n), c.ifTrue, c.ifFalse);
+    }
+  }
+}
+
+static void doIf(const Node &s) {
+  int thenBlock = newBlock();
+  int elseBlock = s.c != NO_NODE ? newBlock() : NO_VALUE;
+  int join = newBlock();
+  condition(s.a, thenBlock, elseBlock != NO_VALUE ? elseBlock : join);
+  sealBlock(thenBlock);
+  current = thenBlock;
+  statements(s.b);
+  jump(join);
+  if (elseBlock != NO_VALUE) {
+    sealBlock(elseBlock);
+    current = elseBlock;
+    statements(s.c);
+    jump(join);
+  }
+  sealBlock(join);
+  current = join;
+}
+
+static void doWhile(const Node &s) {
+  int header = newBlock();
+  jump(header);
+  current = header;
+  int body = newBlock();
+  int exit = newBlock();
+  condition(s.a, body, exit);
+  sealBlock(body);
+  current = body;
+  statements(s.b);
+  jump(header);
+  sealBlock(header);
+  sealBlock(exit);
+  current = exit;
+}
+
+static void callSub(const Node &s) {
+  vector<int> args;
+  for (int arg = s.a; arg != NO_NODE; arg = nodes[arg].next)
+    args.push_back(expression(arg));
+  for (size_t i = 0; i < args.size(); i++)
+    emit(IR_ARG, args[i], NO_VALUE, 0);
+  emit(IR_CALL, NO_VALUE, args.size(), s.value);
+}
+
+//give a global, parameter or local the value v
+static void assign(const Node &target, int v) {
+  if (target.kind == NODE_PARAM)
+    writeVariable(target.value, current, v);
+  else
+    emit(IR_STORE, v, NO_VALUE, target.value);
+}
+
+static void statement(int n) {
+  const Node s = nodes[n];
+  switch (s.kind) {
+  case NODE_IF:
+    doIf(s);
+    break;
+  case NODE_WHILE:
+    doWhile(s);
+    break;
+  case NODE_READ:
+    for (int v = s.a; v != NO_NODE; v = nodes[v].next)
+      assign(nodes[v], emit(IR_READ, NO_VALUE, NO_VALUE, 0));
+    break;
+  case NODE_WRITE:
+    for (int e = s.a; e != NO_NODE; e = nodes[e].next)
+      emit(IR_WRITE, expression(e), NO_VALUE, 0);
+    break;
+  case NODE_SUB:
+    pendingSubs.push_back(n);
+    break;
+  case NODE_CALL:
+    callSub(s);
+    break;
+  case NODE_ASSIGN:
+    assign(nodes[s.a], expression(s.b));
+    break;
+  }
+}
+
+static void statements(int n) {
+  for (int s = nodes[n].a; s != NO_NODE; s = nodes[s].next)
+    statement(s);
+}
+
+//rewrite operands through removed phis and drop the dead phis
+static void finishFunction() {
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    IrBlock &block = fn->blocks[b];
+    for (size_t i = 0; i < block.insts.size(); i++) {
+      IrInst &inst = block.insts[i];
+      int n = operandCount(inst);
+      if (n > 0)
+        inst.a = resolve(inst.a);
+      if (n > 1)
+        inst.b = resolve(inst.b);
+    }
+    vector<IrPhi> live;
+    for (size_t p = 0; p < block.phis.size(); p++) {
+      IrPhi &phi = block.phis[p];
+      if (alias[phi.dst] != phi.dst)
+        continue;
+      for (size_t a = 0; a < phi.args.size(); a++)
+        phi.args[a] = resolve(phi.args[a]);
+      live.push_back(phi);
+    }
+    block.phis.swap(live);
+  }
+}
+
+//translate a function body, parameters are numbered as in the parser:
+//formals 1 to paramCount, locals from paramCount+3 on
+static void buildFunction(int symbol, int paramCount, int localCount, int body) {
+  irFunctions.push_back(IrFunction());
+  fn = &irFunctions.back();
+  fn->symbol = symbol;
+  fn->paramCount = paramCount;
+  fn->valueCount = 0;
+  currentDef.assign(paramCount + localCount + 3, vector<int>());
+  sealed.clear();
+  incomplete.clear();
+  alias.clear();
+
+  current = newBlock();
+  sealBlock(current);
+  for (int p = 1; p <= paramCount; p++)
+    writeVariable(p, current, emit(IR_PARAM, NO_VALUE, NO_VALUE, p));
+  for (int l = 1; l <= localCount; l++)
+    writeVariable(paramCount + 2 + l, current, emit(IR_CONST, NO_VALUE, NO_VALUE, 0));
+  statements(body);
+  emit(IR_RETURN, NO_VALUE, NO_VALUE, 0);
+  finishFunction();
+  splitCriticalEdges(*fn);
+}
+
+void buildIr(int program) {
+  TRACE(TRACE_LEVEL_PHASE, "buildIr()");
+  irFunctions.clear();
+  irGlobals.clear();
+  pendingSubs.clear();
+  const Node p = nodes[program];
+  for (int d = p.a; d != NO_NODE; d = nodes[d].next) {
+    IrGlobal g;
+    g.symbol = nodes[d].value;
+    g.value = nodes[nodes[d].b].value;
+    irGlobals.push_back(g);
+  }
+  buildFunction(-1, 0, 0, p.b);
+  for (size_t i = 0; i < pendingSubs.size(); i++) {
+    const Node s = nodes[pendingSubs[i]];
+    buildFunction(s.value, s.b, s.c, s.a);
+  }
+}
@@ -0,0 +1,441 @@
+#include "ir.h"
+#include "fold.h"
+#include "tokens.h"
+#include "identifiers.h"
+#include "trace.h"
+
+using namespace std;
+
+// optimizations over the SSA form, run between buildIr and generate
+//
+// globals nothing ever stores to or reads into are constants and their
+// loads become immediates. Each function then gets sparse conditional
+// constant propagation (Wegman and Zadeck), which folds expressions,
+// follows constants through phis and finds branches that always go one
+// way, and a dead code sweep for the values nothing uses any more.
+
+const int LATTICE_UNKNOWN  = 0;  // no definition has been reached yet
+const int LATTICE_CONSTANT = 1;
+const int LATTICE_VARYING  = 2;
+
+struct LatticeValue {
+  int state;
+  int64_t value;
+};
+
+static thread_local IrFunction *fn;
+static thread_local vector<LatticeValue> lattice;    // indexed by value
+static thread_local vector<char> reachable;          // indexed by block
+static thread_local vector<vector<char> > taken;     // per block, parallel to succs
+static thread_local bool changed;
+
+static LatticeValue constant(int64_t value) {
+  LatticeValue l;
+  l.state = LATTICE_CONSTANT;
+  l.value = value;
+  return l;
+}
+
+static LatticeValue varying() {
+  LatticeValue l;
+  l.state = LATTICE_VARYING;
+  l.value = 0;
+  return l;
+}
+
+//combine the values flowing into a phi
+static LatticeValue meet(LatticeValue a, LatticeValue b) {
+  if (a.state == LATTICE_UNKNOWN)
+    return b;
+  if (b.state == LATTICE_UNKNOWN)
+    return a;
+  if (a.state == LATTICE_CONSTANT && b.state == LATTICE_CONSTANT && a.value == b.value)
+    return a;
+  return varying();
+}
+
+//lower the lattice value of v, values only ever move toward varying
+static void lower(int v, LatticeValue l) {
+  LatticeValue &old = lattice[v];
+  if (l.state < old.state)
+    return;
+  if (l.state == old.state && (l.state != LATTICE_CONSTANT || l.value == old.value))
+    return;
+  if (l.state == LATTICE_CONSTANT && old.state == LATTICE_CONSTANT)
+    l = varying();
+  old = l;
+  changed = true;
+}
+
+//operator or relation an instruction computes
+static int operatorOf(const IrInst &i) {
+  switch (i.op) {
+  case IR_ADD:  return OP_ADD;
+  case IR_SUB:  return OP_SUB;
+  case IR_MUL:  return OP_MULT;
+  case IR_DIV:  return OP_DIV;
+  case IR_AND:  return OP_REL_A;
+  case IR_OR:   return OP_OR;
+  case IR_XOR:  return OP_XOR;
+  default:      return i.cond;  // IR_CMP and IR_BRANCH
+  }
+}
+
+static LatticeValue evaluate(const IrInst &i) {
+  switch (i.op) {
+  case IR_CONST:
+    return constant(i.imm);
+  case IR_NOT: {
+    LatticeValue a = lattice[i.a];
+    if (a.state == LATTICE_CONSTANT)
+      a.value = foldNot(a.value);
+    return a;
+  }
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+  case IR_DIV:
+  case IR_AND:
+  case IR_OR:
+  case IR_XOR:
+  case IR_CMP:
+  case IR_BRANCH: {
+    LatticeValue a = lattice[i.a];
+    LatticeValue b = lattice[i.b];
+    if (a.state == LATTICE_VARYING || b.state == LATTICE_VARYING)
+      return varying();
+    if (a.state == LATTICE_UNKNOWN || b.state == LATTICE_UNKNOWN)
+      return a.state == LATTICE_UNKNOWN ? a : b;
+    int64_t result;
+    if (!foldOperator(operatorOf(i), a.value, b.value, result))
+      return varying();
+    return constant(result);
+  }
+  default:
+    return varying();  // parameters, loads
+  }
+}
+
+//what a branch tests, 0 to take succs[1]
+static LatticeValue branchValue(const IrInst &i) {
+  if (i.cond == 0)
+    return lattice[i.a];
+  return evaluate(i);
+}
+
+static void takeEdge(int b, int k) {
+  if (taken[b][k])
+    return;
+  taken[b][k] = true;
+  reachable[fn->blocks[b].succs[k]] = true;
+  changed = true;
+}
+
+//true if control can flow from pred into b
+static bool edgeTaken(int pred, int b) {
+  if (!reachable[pred])
+    return false;
+  const vector<int> &succs = fn->blocks[pred].succs;
+  for (size_t k = 0; k < succs.size(); k++)
+    if (succs[k] == b && taken[pred][k])
+      return true;
+  return false;
+}
+
+//find the value of everything reachable, repeating until nothing changes
+static void propagate(const vector<int> &order) {
+  lattice.assign(fn->valueCount, LatticeValue());
+  reachable.assign(fn->blocks.size(), false);
+  taken.assign(fn->blocks.size(), vector<char>());
+  for (size_t b = 0; b < fn->blocks.size(); b++)
+    taken[b].assign(fn->blocks[b].succs.size(), false);
+  reachable[0] = true;
+  changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t o = 0; o < order.size(); o++) {
+      int b = order[o];
+      if (!reachable[b])
+        continue;
+      const IrBlock &block = fn->blocks[b];
+      for (size_t p = 0; p < block.phis.size(); p++) {
+        LatticeValue l = LatticeValue();
+        for (size_t a = 0; a < block.phis[p].args.size(); a++)
+          if (edgeTaken(block.preds[a], b))
+            l = meet(l, lattice[block.phis[p].args[a]]);
+        lower(block.phis[p].dst, l);
+      }
+      for (size_t k = 0; k < block.insts.size(); k++) {
+        const IrInst &inst = block.insts[k];
+        if (inst.dst != NO_VALUE)
+          lower(inst.dst, evaluate(inst));
+        else if (inst.op == IR_JUMP)
+          takeEdge(b, 0);
+        else if (inst.op == IR_BRANCH) {
+          LatticeValue c = branchValue(inst);
+          if (c.state == LATTICE_VARYING) {
+            takeEdge(b, 0);
+            takeEdge(b, 1);
+          } else if (c.state == LATTICE_CONSTANT) {
+            takeEdge(b, c.value != 0 ? 0 : 1);
+          }
+        }
+      }
+    }
+  }
+}
+
+//drop the edge from one block to another along with its phi arguments
+static void removeEdge(int from, int to) {
+  IrBlock &target = fn->blocks[to];
+  for (size_t p = 0; p < target.preds.size(); p++) {
+    if (target.preds[p] != from)
+      continue;
+    target.preds.erase(target.preds.begin() + p);
+    for (size_t i = 0; i < target.phis.size(); i++)
+      target.phis[i].args.erase(target.phis[i].args.begin() + p);
+    break;
+  }
+  vector<int> &succs = fn->blocks[from].succs;
+  for (size_t s = 0; s < succs.size(); s++) {
+    if (succs[s] == to) {
+      succs.erase(succs.begin() + s);
+      break;
+    }
+  }
+}
+
+static IrInst constantInst(int dst, int64_t value) {
+  IrInst i = IrInst();
+  i.op = IR_CONST;
+  i.dst = dst;
+  i.a = NO_VALUE;
+  i.b = NO_VALUE;
+  i.imm = value;
+  return i;
+}
+
+//replace what propagation proved constant, returns how many values
+static int rewriteConstants() {
+  int folded = 0;
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    IrBlock &block = fn->blocks[b];
+    if (!reachable[b])
+      continue;
+    vector<IrPhi> phis;
+    vector<IrInst> constants;
+    for (size_t p = 0; p < block.phis.size(); p++) {
+      LatticeValue l = lattice[block.phis[p].dst];
+      if (l.state == LATTICE_CONSTANT) {
+        constants.push_back(constantInst(block.phis[p].dst, l.value));
+        folded++;
+      } else {
+        phis.push_back(block.phis[p]);
+      }
+    }
+    block.phis.swap(phis);
+    block.insts.insert(block.insts.begin(), constants.begin(), constants.end());
+    for (size_t k = 0; k < block.insts.size(); k++) {
+      IrInst &inst = block.insts[k];
+      if (inst.dst != NO_VALUE && inst.op != IR_CONST && lattice[inst.dst].state == LATTICE_CONSTANT) {
+        inst = constantInst(inst.dst, lattice[inst.dst].value);
+        folded++;
+      }
+    }
+    IrInst &last = block.insts.back();
+    LatticeValue c = last.op == IR_BRANCH ? branchValue(last) : varying();
+    if (c.state == LATTICE_CONSTANT) {
+      int dropped = block.succs[c.value != 0 ? 1 : 0];
+      last.op = IR_JUMP;
+      last.cond = 0;
+      last.a = NO_VALUE;
+      last.b = NO_VALUE;
+      removeEdge(b, dropped);
+    }
+  }
+  return folded;
+}
+
+//delete blocks control never reaches and renumber the rest
+static void removeUnreachable() {
+  vector<int> order = blockOrder(*fn);
+  vector<int> renumber(fn->blocks.size(), -1);
+  for (size_t i = 0; i < order.size(); i++)
+    renumber[order[i]] = 0;
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    if (renumber[b] >= 0)
+      continue;
+    while (!fn->blocks[b].succs.empty())
+      removeEdge(b, fn->blocks[b].succs[0]);
+  }
+  int n = 0;
+  for (size_t b = 0; b < fn->blocks.size(); b++)
+    if (renumber[b] >= 0)
+      renumber[b] = n++;
+  vector<IrBlock> blocks;
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    if (renumber[b] < 0)
+      continue;
+    blocks.push_back(fn->blocks[b]);
+    IrBlock &block = blocks.back();
+    for (size_t p = 0; p < block.preds.size(); p++)
+      block.preds[p] = renumber[block.preds[p]];
+    for (size_t s = 0; s < block.succs.size(); s++)
+      block.succs[s] = renumber[block.succs[s]];
+  }
+  fn->blocks.swap(blocks);
+}
+
+//replace phis left with a single argument, or the same one throughout
+static void removeTrivialPhis() {
+  vector<int> alias(fn->valueCount);
+  for (int v = 0; v < fn->valueCount; v++)
+    alias[v] = v;
+  bool again = true;
+  while (again) {
+    again = false;
+    for (size_t b = 0; b < fn->blocks.size(); b++) {
+      vector<IrPhi> &phis = fn->blocks[b].phis;
+      for (size_t p = 0; p < phis.size(); p++) {
+        int same = NO_VALUE;
+        bool trivial = true;
+        for (size_t a = 0; a < phis[p].args.size() && trivial; a++) {
+          int v = phis[p].args[a];
+          while (alias[v] != v)
+            v = alias[v];
+          if (v == phis[p].dst || v == same)
+            continue;
+          trivial = same == NO_VALUE;
+          same = v;
+        }
+        if (!trivial || same == NO_VALUE)
+          continue;
+        alias[phis[p].dst] = same;
+        phis.erase(phis.begin() + p);
+        p--;
+        again = true;
+      }
+    }
+  }
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    IrBlock &block = fn->blocks[b];
+    for (size_t p = 0; p < block.phis.size(); p++)
+      for (size_t a = 0; a < block.phis[p].args.size(); a++)
+        while (alias[block.phis[p].args[a]] != block.phis[p].args[a])
+          block.phis[p].args[a] = alias[block.phis[p].args[a]];
+    for (size_t k = 0; k < block.insts.size(); k++) {
+      IrInst &inst = block.insts[k];
+      int n = operandCount(inst);
+      if (n > 0)
+        while (alias[inst.a] != inst.a)
+          inst.a = alias[inst.a];
+      if (n > 1)
+        while (alias[inst.b] != inst.b)
+          inst.b = alias[inst.b];
+    }
+  }
+}
+
+//true for instructions that matter even when their value is never used
+static bool hasEffect(const IrInst &i) {
+  return i.dst == NO_VALUE || i.op == IR_READ;  // a read consumes input
+}
+
+//delete instructions and phis whose values nothing with an effect needs
+static int removeDeadCode() {
+  vector<const IrInst *> defs(fn->valueCount, (const IrInst *)NULL);
+  vector<const IrPhi *> phiDefs(fn->valueCount, (const IrPhi *)NULL);
+  vector<int> work;
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    const IrBlock &block = fn->blocks[b];
+    for (size_t p = 0; p < block.phis.size(); p++)
+      phiDefs[block.phis[p].dst] = &block.phis[p];
+    for (size_t k = 0; k < block.insts.size(); k++) {
+      const IrInst &inst = block.insts[k];
+      if (!hasEffect(inst)) {
+        defs[inst.dst] = &inst;
+        continue;
+      }
+      int n = operandCount(inst);
+      if (n > 0)
+        work.push_back(inst.a);
+      if (n > 1)
+        work.push_back(inst.b);
+    }
+  }
+  vector<char> live(fn->valueCount, false);
+  while (!work.empty()) {
+    int v = work.back();
+    work.pop_back();
+    if (live[v])
+      continue;
+    live[v] = true;
+    if (defs[v] != NULL) {
+      int n = operandCount(*defs[v]);
+      if (n > 0)
+        work.push_back(defs[v]->a);
+      if (n > 1)
+        work.push_back(defs[v]->b);
+    } else if (phiDefs[v] != NULL) {
+      work.insert(work.end(), phiDefs[v]->args.begin(), phiDefs[v]->args.end());
+    }
+  }
+  int removed = 0;
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    IrBlock &block = fn->blocks[b];
+    vector<IrPhi> phis;
+    for (size_t p = 0; p < block.phis.size(); p++)
+      if (live[block.phis[p].dst])
+        phis.push_back(block.phis[p]);
+    vector<IrInst> insts;
+    for (size_t k = 0; k < block.insts.size(); k++)
+      if (hasEffect(block.insts[k]) || live[block.insts[k].dst])
+        insts.push_back(block.insts[k]);
+    removed += block.phis.size() - phis.size() + block.insts.size() - insts.size();
+    block.phis.swap(phis);
+    block.insts.swap(insts);
+  }
+  return removed;
+}
+
+//turn loads of globals that are never written into their initial value
+static void propagateGlobals() {
+  vector<char> written(identifierCount(), false);
+  for (size_t f = 0; f < irFunctions.size(); f++)
+    for (size_t b = 0; b < irFunctions[f].blocks.size(); b++)
+      for (size_t k = 0; k < irFunctions[f].blocks[b].insts.size(); k++) {
+        const IrInst &inst = irFunctions[f].blocks[b].insts[k];
+        if (inst.op == IR_STORE)
+          written[inst.imm] = true;
+      }
+  vector<char> isConstant(identifierCount(), false);
+  vector<int64_t> initial(identifierCount(), 0);
+  for (size_t g = 0; g < irGlobals.size(); g++) {
+    isConstant[irGlobals[g].symbol] = !written[irGlobals[g].symbol];
+    initial[irGlobals[g].symbol] = irGlobals[g].value;
+  }
+  for (size_t f = 0; f < irFunctions.size(); f++)
+    for (size_t b = 0; b < irFunctions[f].blocks.size(); b++)
+      for (size_t k = 0; k < irFunctions[f].blocks[b].insts.size(); k++) {
+        IrInst &inst = irFunctions[f].blocks[b].insts[k];
+        if (inst.op == IR_LOAD && isConstant[inst.imm])
+          inst = constantInst(inst.dst, initial[inst.imm]);
+      }
+}
+
+static void optimizeFunction(IrFunction &f) {
+  fn = &f;
+  propagate(blockOrder(f));
+  int folded = rewriteConstants();
+  removeUnreachable();
+  removeTrivialPhis();
+  int removed = removeDeadCode();
+  TRACE(TRACE_LEVEL_PHASE, "optimizeIr() %d values folded, %d dead", folded, removed);
+}
+
+void optimizeIr() {
+  TRACE(TRACE_LEVEL_PHASE, "optimizeIr()");
+  propagateGlobals();
+  for (size_t f = 0; f < irFunctions.size(); f++)
+    optimizeFunction(irFunctions[f]);
+}
@@ -0,0 +1,65 @@
+#include "jit.h"
+#include "assembler.h"
+#include "trace.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdio.h>
+
+#ifdef __linux
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+void abort(string);
+
+#ifdef __linux
+const uint64_t PAGE_SIZE = 0x1000;
+
+static uint64_t pages(uint64_t bytes) {
+  return (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+void runInProcess() {
+  // .text gets pages of its own so it can be made executable on its own,
+  // .bss follows .data and is already zero in a fresh mapping
+  uint64_t textSize = pages(objectText.size());
+  uint64_t bssStart = (objectData.size() + 15) / 16 * 16;
+  uint64_t size = textSize + pages(bssStart + objectBssSize);
+  // the code uses 32 bit absolute addresses
+  uint8_t *memory = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  if (memory == MAP_FAILED)
+    abort("could not map memory to run the program in");
+  uint64_t base = (uint64_t)memory;
+  uint64_t sectionAddress[3] = {base, base + textSize, base + textSize + bssStart};
+
+  uint64_t entry = 0;
+  for (size_t s = 0; s < objectSymbols.size(); s++)
+    if (objectSymbols[s].name == "main" && objectSymbols[s].section == SECTION_TEXT)
+      entry = sectionAddress[SECTION_TEXT] + objectSymbols[s].value;
+  if (entry == 0)
+    abort("no main to run");
+
+  vector<uint8_t> text = relocatedText(sectionAddress);
+  memcpy(memory, &text[0], text.size());
+  if (!objectData.empty())
+    memcpy(memory + textSize, &objectData[0], objectData.size());
+  if (mprotect(memory, textSize, PROT_READ | PROT_EXEC) != 0)
+    abort("could not make the program executable");
+
+  TRACE(TRACE_LEVEL_PHASE, "runInProcess() at %d", (int64_t)entry);
+  // the program leaves with the exit syscall, atexit handlers won't run and
+  // what is buffered here has to go out first
+  traceDump();
+  cout.flush();
+  fflush(stdout);
+  ((void (*)())entry)();
+}
+
+#else
+void runInProcess() {
+  abort("-run is only supported on linux");
+}
+#endif
@@ -0,0 +1,14 @@
+#ifndef JIT_H
+#define JIT_H
+
+// running the assembled program inside the compiler process
+//
+// .text, .data and .bss are copied into memory mapped below 2GB, the
+// relocations are applied for where they landed and main is called. The
+// program's own runtime does the reading and writing, and its exit
+// syscall ends the compiler process too, so this doesn't return.
+
+//run the program after finishAssembly
+void runInProcess();
+
+#endif // JIT_H
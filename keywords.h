@@ -0,0 +1,147 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <string>
+#include <string.h>
+
+#include "tokens.h"
+
+// keyword and operator classification, every table here is built by the
+// compiler so recognizing a token is a hash or an index, never a search
+
+struct Keyword {
+  const char *name;
+  int length;
+  int token;
+};
+
+constexpr Keyword keywords[] = {
+  {"if",      2, SYM_IF},
+  {"else",    4, SYM_ELSE},
+  {"endif",   5, SYM_ENDIF},
+  {"while",   5, SYM_WHILE},
+  {"wend",    4, SYM_WEND},
+  {"dim",     3, SYM_DIM},
+  {"main",    4, SYM_MAIN},
+  {"endmain", 7, SYM_END_MAIN},
+  {"read",    4, SYM_READ},
+  {"write",   5, SYM_WRITE},
+  {"sub",     3, SYM_SUB},
+  {"endsub",  6, SYM_END_SUB},
+  {"const",   5, SYM_CONST}
+};
+
+const int KEYWORD_COUNT = sizeof(keywords) / sizeof(keywords[0]);
+const int KEYWORD_MIN_LENGTH = 2;
+const int KEYWORD_MAX_LENGTH = 7;
+const int KEYWORD_SLOTS = 16;
+
+//perfect hash of a keyword candidate, n must be at least 2
+constexpr int keywordHash(const char *s, int n) {
+  return ((unsigned char)s[0] * 12 + (unsigned char)s[1] * 4 +
+          (unsigned char)s[n-1] * 2 + n) & (KEYWORD_SLOTS - 1);
+}
+
+//index of the keyword hashing to slot, -1 for an empty slot
+constexpr int keywordInSlot(int slot, int i = 0) {
+  return i == KEYWORD_COUNT ? -1
+       : keywordHash(keywords[i].name, keywords[i].length) == slot ? i
+       : keywordInSlot(slot, i + 1);
+}
+
+//number of keywords hashing to the same slot as keyword i
+constexpr int keywordCollisions(int i, int j = 0) {
+  return j == KEYWORD_COUNT ? 0
+       : (keywordHash(keywords[i].name, keywords[i].length) ==
+          keywordHash(keywords[j].name, keywords[j].length) && i != j) +
+         keywordCollisions(i, j + 1);
+}
+
+constexpr bool keywordHashIsPerfect(int i = 0) {
+  return i == KEYWORD_COUNT ||
+         (keywordCollisions(i) == 0 && keywordHashIsPerfect(i + 1));
+}
+
+static_assert(keywordHashIsPerfect(),
+              "keywords collide, pick new multipliers for keywordHash");
+
+static const signed char keywordSlots[KEYWORD_SLOTS] = {
+  keywordInSlot(0),  keywordInSlot(1),  keywordInSlot(2),  keywordInSlot(3),
+  keywordInSlot(4),  keywordInSlot(5),  keywordInSlot(6),  keywordInSlot(7),
+  keywordInSlot(8),  keywordInSlot(9),  keywordInSlot(10), keywordInSlot(11),
+  keywordInSlot(12), keywordInSlot(13), keywordInSlot(14), keywordInSlot(15)
+};
+
+//token for an identifier, SYM_IDENT unless it is a keyword
+inline int keywordToken(const std::string &s) {
+  int n = s.length();
+  if (n < KEYWORD_MIN_LENGTH || n > KEYWORD_MAX_LENGTH)
+    return SYM_IDENT;
+  int k = keywordSlots[keywordHash(s.data(), n)];
+  if (k < 0 || keywords[k].length != n || memcmp(keywords[k].name, s.data(), n) != 0)
+    return SYM_IDENT;
+  return keywords[k].token;
+}
+
+//operator token of a character, OPERATOR_OFFSET if it is not an operator
+constexpr int operatorOf(int c) {
+  return c == '|' ? OP_OR
+       : c == '~' ? OP_XOR
+       : c == '+' ? OP_ADD
+       : c == '-' ? OP_SUB
+       : c == '*' ? OP_MULT
+       : c == '/' ? OP_DIV
+       : c == '=' ? OP_REL_E
+       : c == '#' ? OP_REL_NE
+       : c == '<' ? OP_REL_L
+       : c == '>' ? OP_REL_G
+       : c == '(' ? OP_PAR_O
+       : c == ')' ? OP_PAR_C
+       : c == '!' ? OP_REL_N
+       : c == '&' ? OP_REL_A
+       : c == ',' ? OP_COMMA
+       : c == ';' ? OP_SEMICOLON
+       : OPERATOR_OFFSET;
+}
+
+//variable type selected by a type suffix character after a name in dim
+constexpr int suffixOf(int c) {
+  return c == '$' ? TYPE_STRING
+       : c == '#' ? TYPE_FLOAT
+       : TYPE_INT;
+}
+
+struct OperatorEntry {
+  short token;
+  signed char varType;
+};
+
+#define OPERATOR_ENTRY(c)   {operatorOf(c), suffixOf(c)}
+#define OPERATOR_ROW_4(c)   OPERATOR_ENTRY(c), OPERATOR_ENTRY(c+1), \
+                            OPERATOR_ENTRY(c+2), OPERATOR_ENTRY(c+3)
+#define OPERATOR_ROW_16(c)  OPERATOR_ROW_4(c), OPERATOR_ROW_4(c+4), \
+                            OPERATOR_ROW_4(c+8), OPERATOR_ROW_4(c+12)
+#define OPERATOR_ROW_64(c)  OPERATOR_ROW_16(c), OPERATOR_ROW_16(c+16), \
+                            OPERATOR_ROW_16(c+32), OPERATOR_ROW_16(c+48)
+
+// indexed by the unsigned value of a character
+static const OperatorEntry operatorTable[256] = {
+  OPERATOR_ROW_64(0), OPERATOR_ROW_64(64), OPERATOR_ROW_64(128), OPERATOR_ROW_64(192)
+};
+
+#undef OPERATOR_ENTRY
+#undef OPERATOR_ROW_4
+#undef OPERATOR_ROW_16
+#undef OPERATOR_ROW_64
+
+//operator token of a character
+inline int operatorToken(char c) {
+  return operatorTable[(unsigned char)c].token;
+}
+
+//variable type of a type suffix character, TYPE_INT if it is not a suffix
+inline int suffixType(char c) {
+  return operatorTable[(unsigned char)c].varType;
+}
+
+#endif // KEYWORDS_H
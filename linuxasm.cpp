@@ -1,16 +1,23 @@
 #include "linuxasm.h"
+#include "trace.h"
+#include "outputBuffer.h"
 
 
 using namespace std;
 
-extern string value;
 extern void emitLn(string);
 extern void postLabel(string);
-extern bool inTable(string);
-extern void undefined(string);
 extern string newLabel();
 
-extern int base;
+extern thread_local int base;
+
+// bytes written are collected here and go out in one syscall when the
+// buffer fills, before a read and at exit
+static const char *OUTPUT_BUFFER_SIZE = "65536";
+
+// input is read a buffer at a time and parsed from there, the buffer has
+// room after the data for a sentinel and for loading 8 bytes past it
+static const char *INPUT_BUFFER_SIZE = "65536";
 
 /////////////////////////////////////////////////////
 ////////////////////////////////////////////////////
@@ -29,212 +36,329 @@ extern int base;
 void header() {
   emitLn("global main");
   emitLn("");
+  emitLn("section .bss");
+  emitLn("global_output_buffer: RESB " + string(OUTPUT_BUFFER_SIZE));
+  emitLn("global_input_buffer: RESB " + string(INPUT_BUFFER_SIZE) + "+16");
   emitLn("section .data");
-  //work around for write function
-  // TODO find a way to mov eax into rsi
-  // and remove the byte buffer
-  emitLn("global_byte_buffer: DB 0");
+  emitLn("global_output_length: DQ 0");
+  emitLn("global_input_position: DQ 0");
+  emitLn("global_input_length: DQ 0");
+  emitLn("global_input_done: DQ 0");
+  emitLn("global_input_powers: DQ 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000");
 }
 
 //write the prolog
 void prolog() {
   emitLn("section .text");
-  postLabel("main");
 }
 
 //write the epilog
 void epilog() {
+  call("flush_output");
   emitLn("MOV rax,60  ;send exit command");
   emitLn("xor rdi, rdi");
   emitLn("syscall");
 }
 
-//Clear the primary register
-void Clear() { emitLn("xor rax,rax"); }
+//flush_output writes the buffer to standard output, a write may take
+//less than asked for so it loops. Errors drop what is left
+static void flushOutput() {
+  string loop = newLabel();
+  string done = newLabel();
+  postLabel("flush_output");
+  emitLn("mov rsi, global_output_buffer");
+  emitLn("mov rdx, qword [global_output_length]");
+  postLabel(loop);
+  emitLn("test rdx, rdx");
+  emitLn("JLE "+done);
+  emitLn("mov eax, 1"); // write
+  emitLn("mov edi, 1"); // standard output
+  emitLn("syscall");
+  emitLn("test rax, rax");
+  emitLn("JLE "+done);
+  emitLn("add rsi, rax");
+  emitLn("sub rdx, rax");
+  emitLn("JMP "+loop);
+  postLabel(done);
+  emitLn("mov qword [global_output_length], 0");
+  Return();
+}
 
-//negate the primary register
-void Negate() { emitLn("neg rax"); }
+//fill_input moves what is left unread to the front of the input buffer
+//and reads as much as fits after it. A 0 byte after the data stops every
+//scan for digits
+static void fillInput() {
+  string got = newLabel();
+  postLabel("fill_input");
+  emitLn("mov rsi, qword [global_input_position]");
+  emitLn("mov rcx, qword [global_input_length]");
+  emitLn("sub rcx, rsi");
+  emitLn("lea rsi, [global_input_buffer+rsi]");
+  emitLn("mov rdi, global_input_buffer");
+  emitLn("rep movsb");
+  emitLn("lea rdx, [global_input_buffer+" + string(INPUT_BUFFER_SIZE) + "]");
+  emitLn("sub rdx, rdi");
+  emitLn("mov rsi, rdi");
+  emitLn("xor edi, edi"); // standard input
+  emitLn("xor eax, eax"); // read
+  emitLn("syscall");
+  emitLn("test rax, rax");
+  emitLn("JG "+got);
+  emitLn("mov qword [global_input_done], 1");
+  emitLn("xor eax, eax");
+  postLabel(got);
+  emitLn("add rsi, rax");
+  emitLn("mov byte [rsi], 0");
+  emitLn("mov rdi, global_input_buffer");
+  emitLn("sub rsi, rdi");
+  emitLn("mov qword [global_input_length], rsi");
+  emitLn("mov qword [global_input_position], 0");
+  Return();
+}
 
-//load a constant value to primary register
-void LoadConst(string n) {
-  emitLn("mov rax," + n);
+//turn the digits in rdx, one per byte with the first in the low byte,
+//into their value. Pairs, then groups of four, then all eight are
+//combined in one register (SWAR)
+static void convertDigits() {
+  emitLn("imul r9, rdx, 10");
+  emitLn("shr rdx, 8");
+  emitLn("add rdx, r9");
+  emitLn("mov r9, 0x00FF00FF00FF00FF");
+  emitLn("and rdx, r9");
+  emitLn("imul r9, rdx, 100");
+  emitLn("shr rdx, 16");
+  emitLn("add rdx, r9");
+  emitLn("mov r9, 0x0000FFFF0000FFFF");
+  emitLn("and rdx, r9");
+  emitLn("imul r9, rdx, 10000");
+  emitLn("shr rdx, 32");
+  emitLn("add rdx, r9");
+  emitLn("mov edx, edx");
+}
+
+//read_integer returns the next whitespace separated integer in rax, 0
+//once the input is used up. Digits are taken 8 at a time, a mask of the
+//bytes outside '0' to '9' finds where the number ends
+static void readInteger() {
+  string next = newLabel();
+  string skip = newLabel();
+  string empty = newLabel();
+  string end = newLabel();
+  string number = newLabel();
+  string digits = newLabel();
+  string chunk = newLabel();
+  string partial = newLabel();
+  string last = newLabel();
+  string done = newLabel();
+  postLabel("read_integer");
+  postLabel(next);
+  emitLn("mov rsi, qword [global_input_position]");
+  postLabel(skip);
+  emitLn("cmp rsi, qword [global_input_length]");
+  emitLn("JAE "+empty);
+  emitLn("movzx eax, byte [global_input_buffer+rsi]");
+  emitLn("cmp eax, 45"); // '-'
+  emitLn("JE "+number);
+  emitLn("sub eax, 48");
+  emitLn("cmp eax, 9");
+  emitLn("JBE "+number);
+  emitLn("inc rsi");
+  emitLn("JMP "+skip);
+  postLabel(empty);
+  emitLn("mov qword [global_input_position], rsi");
+  emitLn("cmp qword [global_input_done], 0");
+  emitLn("JNE "+end);
+  call("fill_input");
+  emitLn("JMP "+next);
+  postLabel(end);
+  emitLn("xor eax, eax");
+  Return();
+  postLabel(number);
+  emitLn("mov qword [global_input_position], rsi");
+  emitLn("xor edi, edi"); // all ones for a negative number
+  emitLn("cmp byte [global_input_buffer+rsi], 45");
+  emitLn("JNE "+digits);
+  emitLn("inc rsi");
+  emitLn("dec rdi");
+  postLabel(digits);
+  emitLn("xor eax, eax");
+  emitLn("mov r8, 0x3030303030303030");
+  emitLn("mov r10, 0x4646464646464646");
+  emitLn("mov r11, 0x8080808080808080");
+  postLabel(chunk);
+  // flag the bytes below '0' and above '9', borrows and carries only
+  // spoil the flags after the first one
+  emitLn("mov rdx, qword [global_input_buffer+rsi]");
+  emitLn("mov r9, rdx");
+  emitLn("sub r9, r8");
+  emitLn("mov rcx, rdx");
+  emitLn("not rcx");
+  emitLn("and r9, rcx");
+  emitLn("lea rcx, [rdx+r10]");
+  emitLn("or rcx, rdx");
+  emitLn("or r9, rcx");
+  emitLn("and r9, r11");
+  emitLn("JNE "+partial);
+  emitLn("sub rdx, r8");
+  convertDigits();
+  emitLn("imul rax, rax, 100000000");
+  emitLn("add rax, rdx");
+  emitLn("add rsi, 8");
+  emitLn("JMP "+chunk);
+  postLabel(partial);
+  emitLn("bsf rcx, r9");
+  emitLn("and ecx, 56"); // 8 times the digits left
+  emitLn("JE "+last);
+  emitLn("imul rax, qword [global_input_powers+rcx]");
+  emitLn("mov r9, rcx");
+  emitLn("shr r9, 3");
+  emitLn("add rsi, r9");
+  emitLn("neg ecx"); // shift out what follows the digits
+  emitLn("add ecx, 64");
+  emitLn("sub rdx, r8");
+  emitLn("shl rdx, cl");
+  convertDigits();
+  emitLn("add rax, rdx");
+  postLabel(last);
+  // a number that runs into the end of the buffer may go on in the next
+  // read, it is parsed again once that is in
+  emitLn("cmp rsi, qword [global_input_length]");
+  emitLn("JNE "+done);
+  emitLn("cmp qword [global_input_done], 0");
+  emitLn("JNE "+done);
+  call("fill_input");
+  emitLn("JMP "+next);
+  postLabel(done);
+  emitLn("mov qword [global_input_position], rsi");
+  emitLn("xor rax, rdi");
+  emitLn("sub rax, rdi");
+  Return();
 }
 
-//load a variable to primary register
-void LoadVar(string name) {
-  stringstream ss;
-  if (!inTable(name)) {
-      ss << name;
-    undefined(ss.str());
-  }
-  ss << "mov ax,[" << name << "]";
-  emitLn(ss.str());
+//write the runtime routines the generated code calls
+void runtime() {
+  flushOutput();
+  fillInput();
+  readInteger();
 }
 
-//push Primary onto stack
-void Push() {
-  emitLn("push rax");
+//allocate storage for a static variable
+void allocate(string name, int64_t value) {
+  TRACE(TRACE_LEVEL_EMIT, "allocate(%s,%d)", name, value);
+  name += ":\tDQ ";
+  appendNumber(name, value);
+  emitLn(name);
 }
 
-//add top of stack to primary
-void PopAdd() {
-  emitLn("pop rbx");
-  emitLn("add rax,rbx");
+//operand for a static variable
+string globalVar(string name) {
+  return "qword [" + name + "]";
 }
 
-//subtract primary from top of stack
-void PopSub() {
-  emitLn("pop rbx");
-  emitLn("sub rax,rbx");
-  emitLn("neg rax");
+//operand for parameter n of the current subroutine
+string paramSlot(int n) {
+  int offset = 16 + 8 * (base - n);
+  string slot = "qword [rbp";
+  if (offset >-1) {
+    slot += '+';
+  }
+  appendNumber(slot, offset);
+  return slot + "]";
 }
 
-//multiply top of stack by primary
-void PopMul() {
-  emitLn("pop rbx");
-  emitLn("mul rbx");
+//operand for spill slot n of the current frame
+string frameSlot(int n) {
+  string slot = "qword [rbp-";
+  appendNumber(slot, 8 * (n + 1));
+  return slot + "]";
 }
 
-//divide top of stack by primary
-void PopDiv() {
-  emitLn("mov rbx,rax");
-  emitLn("pop rax");
-  emitLn("div rbx");
+//copy src to dst
+void Move(string dst, string src) {
+  emitLn("mov " + dst + ", " + src);
 }
 
-//store primary to variable
-void StoreVar(string name) {
-  stringstream ss;
-  if (!inTable(name)) {
-    ss << name;
-    undefined(ss.str());
-  }
-  ss << "mov [" << name << "], ax";
-  emitLn(ss.str());
+//add src to dst
+void Add(string dst, string src) {
+  emitLn("add " + dst + ", " + src);
 }
 
-//load a parameter to the primary register
-void loadParam(int n) {
-  int offset = 16 + 8 * (base - n);
-  stringstream ss;
-  ss << "mov rax, [rbp";
-  if (offset >-1) {
-    ss << "+";
-  }
-  ss << offset << "]";
-  emitLn(ss.str());
+//subtract src from dst
+void Subtract(string dst, string src) {
+  emitLn("sub " + dst + ", " + src);
 }
 
-//store a parameter from the primary register
-void storeParam(int n) {
-  int offset = 16+8*(base-n);
-  stringstream ss;
-  ss << "mov [rbp";
-  if (offset>-1) {
-    ss << "+";
-  }
-  ss << offset << "], rax";
-  emitLn(ss.str());
+//multiply register dst by src
+void Multiply(string dst, string src) {
+  emitLn("imul " + dst + ", " + src);
+}
+
+//divide the primary register by src, src can't be a constant
+void Divide(string src) {
+  emitLn("cqo");
+  emitLn("idiv " + src);
+}
+
+//and src into dst
+void And(string dst, string src) {
+  emitLn("and " + dst + ", " + src);
 }
 
-//complement the primary register
-void NotIt() { emitLn("not rax");}
+//or src into dst
+void Or(string dst, string src) {
+  emitLn("or " + dst + ", " + src);
+}
 
-//and top of stack with primary
-void PopAnd() {
-  emitLn("pop rbx");
-  emitLn("and rax, rbx");
+//XOR src into dst
+void Xor(string dst, string src) {
+  emitLn("xor " + dst + ", " + src);
 }
 
-//or top of stack with primary
-void PopOr() {
-  emitLn("pop rbx");
-  emitLn("or rax, rbx");
+//complement dst
+void Not(string dst) {
+  emitLn("not " + dst);
 }
 
-//XOR top of stack with primary
-void PopXor() {
-  emitLn("pop rbx");
-  emitLn("xor rax, rbx");
+//compare a with b
+void Compare(string a, string b) {
+  emitLn("cmp " + a + ", " + b);
 }
 
-//compare top of stack with primary
-void PopCompare() {
-  emitLn("pop rbx");
-  emitLn("cmp rax, rbx");
+//set primary to 0 or 1 from the flags for condition code cc, setcc and
+//movzx need no branches and no labels
+static void setCondition(string cc) {
+  emitLn("set" + cc + " al");
+  emitLn("movzx eax, al");
 }
 
 //set primary equal
 void setEqual() {
-  string eq = newLabel();
-  string neq = newLabel();
-  emitLn("jne "+neq);
-  emitLn("mov rax, 1");
-  emitLn("jmp "+eq);
-  postLabel(neq);
-  emitLn("mov rax, 0");
-  postLabel(eq);
+  setCondition("e");
 }
 
 //set primary not equal
 void setNEqual() {
-  string eq = newLabel();
-  string neq = newLabel();
-  emitLn("je "+neq);
-  emitLn("mov rax, 1");
-  emitLn("jmp "+eq);
-  postLabel(neq);
-  emitLn("mov rax, 0");
-  postLabel(eq);
+  setCondition("ne");
 }
 
 //set primary to less <
 void setLess() {
-  string eq = newLabel();
-  string neq = newLabel();
-  emitLn("jg "+eq);
-  emitLn("mov rax, 0"); // set al to false
-  emitLn("jmp "+neq);
-  postLabel(eq);
-  emitLn("mov rax, 1"); // set al to true
-  postLabel(neq);
+  setCondition("l");
 }
 
 //set primary if compare was >
 void setGreater() {
-  string eq = newLabel();
-  string neq = newLabel();
-  emitLn("jl "+eq);
-  emitLn("mov rax, 0"); // set ax to false
-  emitLn("jmp "+neq);
-  postLabel(eq);
-  emitLn("mov rax, 1"); // set ax to true
-  postLabel(neq);
+  setCondition("g");
 }
 
 //set primary if compare was <=
 void setLessOrEqual() {
-  string eq = newLabel();
-  string neq = newLabel();
-  emitLn("jge "+eq);
-  emitLn("mov rax, 0"); // set ax to false
-  emitLn("jmp "+neq);
-  postLabel(eq);
-  emitLn("mov rax, 1"); // set ax to true
-  postLabel(neq);
-
+  setCondition("le");
 }
 
 //set primary if compare was >=
 void setGreaterOrEqual() {
-  string eq = newLabel();
-  string neq = newLabel();
-  emitLn("jle "+eq);
-  emitLn("mov rax, 0"); // set ax to false
-  emitLn("jmp "+neq);
-  postLabel(eq);
-  emitLn("mov rax, 1"); // set ax to true
-  postLabel(neq);
+  setCondition("ge");
 }
 
 //branch unconditional
@@ -242,12 +366,46 @@ void branch(string tag) {
   emitLn("JMP "+tag);
 }
 
-//branch not equal
-void branchFalse(string tag) {
-  emitLn("cmp rax, 0");
+//branch if compare was a = b
+void branchEqual(string tag) {
   emitLn("JE "+tag);
 }
 
+//branch if compare was a <> b
+void branchNEqual(string tag) {
+  emitLn("JNE "+tag);
+}
+
+//branch if compare was a < b
+void branchLess(string tag) {
+  emitLn("JL "+tag);
+}
+
+//branch if compare was a > b
+void branchGreater(string tag) {
+  emitLn("JG "+tag);
+}
+
+//branch if compare was a <= b
+void branchLessOrEqual(string tag) {
+  emitLn("JLE "+tag);
+}
+
+//branch if compare was a >= b
+void branchGreaterOrEqual(string tag) {
+  emitLn("JGE "+tag);
+}
+
+//push an argument for a subroutine
+void Push(string src) {
+  emitLn("push " + src);
+}
+
+//pop the top of the stack into dst
+void Pop(string dst) {
+  emitLn("pop " + dst);
+}
+
 //call a subroutine
 void call(string s) {
   emitLn("call "+s);
@@ -258,56 +416,57 @@ void Return() {
   emitLn("RET");
 }
 
-//read variable to primary register
-void readIt(string val) {
-  emitLn("mov rax, 3"); // eax = 3 for write
-  emitLn("mov rbx, 0"); // standard input
-  emitLn("mov rcx, "+val);
-  emitLn("mov rdx, 1");
-  emitLn("syscall");
+//read an integer from standard input into the primary register
+void readIt() {
+  call("flush_output"); // prompts show before the program waits
+  call("read_integer");
 }
 
-//write variable from primary register
+//write variable from primary register, appended to the output buffer
 void writeIt() {
-  emitLn("mov [global_byte_buffer], al"); // temporary work around
-  emitLn("mov rax, 1"); // the system interprets 4 as write
-  emitLn("mov rdi, 1"); // standard output (terminal)
-  emitLn("mov rsi, global_byte_buffer");
-  emitLn("mov rdx, 1");
-  emitLn("syscall");
+  string room = newLabel();
+  emitLn("mov rbx, qword [global_output_length]");
+  emitLn("mov byte [global_output_buffer+rbx], al");
+  emitLn("inc rbx");
+  emitLn("mov qword [global_output_length], rbx");
+  emitLn("cmp rbx, " + string(OUTPUT_BUFFER_SIZE));
+  emitLn("JNE "+room);
+  call("flush_output");
+  postLabel(room);
 }
 
 //intro to a subroutine
-void subProlog(string name, int locVarCount) {
-  stringstream ss;
-  ss << "subProlog(" << name << "," << locVarCount << ")";
-  debug(ss.str());
-  ss.clear(); ss.str("");
+void subProlog(string name, int slotCount) {
+  TRACE(TRACE_LEVEL_EMIT, "subProlog(%s,%d)", name, slotCount);
   postLabel(name);
   emitLn("push rbp");
   emitLn("mov rbp, rsp");
-
-  ss << "sub rsp, " << (8*locVarCount);
-  emitLn(ss.str());
+  if (slotCount > 0) {
+    string sub = "sub rsp, ";
+    appendNumber(sub, 8*slotCount);
+    emitLn(sub);
+  }
 }
 
 //ending to a procedure
-void subEpilog(int locVarCount) {
-  stringstream ss;
-  ss << "subEpilog(" << locVarCount << ")";
-  debug(ss.str());
-  ss.clear(); ss.str("");
-  ss <<"add rsp, " << (8*locVarCount);
-  emitLn(ss.str());
+void subEpilog(int slotCount) {
+  TRACE(TRACE_LEVEL_EMIT, "subEpilog(%d)", slotCount);
+  if (slotCount > 0) {
+    string add = "add rsp, ";
+    appendNumber(add, 8*slotCount);
+    emitLn(add);
+  }
   emitLn("pop rbp");
   Return();
 }
 
 //adjust the stack pointer upwards by n bytes
 void cleanStack(int n) {
-  stringstream ss;
-  ss << "add rsp, " << n;
-  emitLn(ss.str());
+  if (n == 0)
+    return;
+  string add = "add rsp, ";
+  appendNumber(add, n);
+  emitLn(add);
 }
 
 //////////////////////////////////////////////
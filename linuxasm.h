@@ -4,90 +4,110 @@
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <stdint.h>
+
+// operands are nasm text: a register name, a constant, or memory from
+// globalVar, paramSlot or frameSlot. At most one operand of an
+// instruction may be in memory
 
 //write header info
 void header();
 
+//allocate storage for a static variable
+void allocate(std::string name, int64_t value);
+
 //write the prolog
 void prolog();
 
 //write the epilog
 void epilog();
 
-//Clear the primary register
-void Clear();
-
-//negate the primary register
-void Negate();
+//write the runtime routines the generated code calls
+void runtime();
 
-//load a constant value to primary register
-void LoadConst(std::string);
+//operand for a static variable
+std::string globalVar(std::string name);
 
-//load a variable to primary register
-void LoadVar(std::string);
+//operand for parameter n of the current subroutine
+std::string paramSlot(int n);
 
-//push Primary onto stack
-void Push();
+//operand for spill slot n of the current frame
+std::string frameSlot(int n);
 
-//add top of stack to primary
-void PopAdd();
+//copy src to dst
+void Move(std::string dst, std::string src);
 
-//subtract primary from top of stack
-void PopSub();
+//add src to dst
+void Add(std::string dst, std::string src);
 
-//multiply top of stack by primary
-void PopMul();
+//subtract src from dst
+void Subtract(std::string dst, std::string src);
 
-//divide top of stack by primary
-void PopDiv();
+//multiply register dst by src
+void Multiply(std::string dst, std::string src);
 
-//store primary to variable
-void StoreVar(std::string);
+//divide the primary register by src, src can't be a constant
+void Divide(std::string src);
 
-//load a parameter to the primary register
-void loadParam(int n);
+//and src into dst
+void And(std::string dst, std::string src);
 
-//store a parameter from the primary register
-void storeParam(int n);
+//or src into dst
+void Or(std::string dst, std::string src);
 
-//complement the primary register
-void NotIt();
+//XOR src into dst
+void Xor(std::string dst, std::string src);
 
-//and top of stack with primary
-void PopAnd();
+//complement dst
+void Not(std::string dst);
 
-//or top of stack with primary
-void PopOr();
+//compare a with b
+void Compare(std::string a, std::string b);
 
-//XOR top of stack with primary
-void PopXor();
-
-//compare top of stack with primary
-void PopCompare();
-
-//set primary equal
+//set primary if compare was a = b
 void setEqual();
 
-//set primary not equal
+//set primary if compare was a <> b
 void setNEqual();
 
-//set primary to less <
+//set primary if compare was a < b
 void setLess();
 
-//set primary if compare was >
+//set primary if compare was a > b
 void setGreater();
 
-//set primary if compare was <=
+//set primary if compare was a <= b
 void setLessOrEqual();
 
-//set primary if compare was =>
+//set primary if compare was a >= b
 void setGreaterOrEqual();
 
 //branch unconditional
 void branch(std::string);
 
-//branch not equal
-void branchFalse(std::string);
+//branch if compare was a = b
+void branchEqual(std::string tag);
+
+//branch if compare was a <> b
+void branchNEqual(std::string tag);
+
+//branch if compare was a < b
+void branchLess(std::string tag);
+
+//branch if compare was a > b
+void branchGreater(std::string tag);
+
+//branch if compare was a <= b
+void branchLessOrEqual(std::string tag);
+
+//branch if compare was a >= b
+void branchGreaterOrEqual(std::string tag);
+
+//push an argument for a subroutine
+void Push(std::string src);
+
+//pop the top of the stack into dst
+void Pop(std::string dst);
 
 //call a subroutine
 void call(std::string);
@@ -95,17 +115,17 @@ void call(std::string);
 //return from subroutine
 void Return();
 
-//read variable to primary register
-void readIt(std::string);
+//read an integer from standard input into the primary register
+void readIt();
 
 //write variable from primary register
 void writeIt();
 
-//intro to a subroutine
-void subProlog(std::string name, int locVarCount);
+//intro to a subroutine with slotCount spill slots
+void subProlog(std::string name, int slotCount);
 
 //ending to a procedure
-void subEpilog(int locVarCount);
+void subEpilog(int slotCount);
 
 //adjust the stack pointer upwards by n bytes
 void cleanStack(int);
@@ -4,22 +4,38 @@
 #include <string>
 #include <fstream>
 #include <sstream>
-#include <map>
+#include <vector>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
 
 #include "tokens.h"
+#include "keywords.h"
 #include "argumentParser.h"
+#include "sourceReader.h"
+#include "identifiers.h"
+#include "trace.h"
+#include "ast.h"
+#include "ir.h"
+#include "codegen.h"
+#include "peephole.h"
+#include "assembler.h"
+#include "elfWriter.h"
+#include "jit.h"
+#include "bytecode.h"
+#include "buildCache.h"
+#include "b4gl.h"
+#include "process.h"
+#include "metrics.h"
+#include "outputBuffer.h"
 
 
 #ifdef __linux
   #include "linuxasm.h"
   int CURRENT_OS = OS_LINUX;
-  #define _popen NULL;
-#define _pclose NULL;
 #else
   #include "winasm.h"
   int CURRENT_OS = OS_WINDOWS;
-  #define popen NULL;
-  #define pclose NULL;
 #endif
 
 /*  BNF
@@ -33,49 +49,79 @@ using namespace std;
 const char TAB = '\t';
 const char CR = '\r';
 const char LF = '\n';
-char look;
-ifstream *inputFile = NULL;
-ofstream *outputFile = NULL;
+thread_local char look;
+thread_local bool writeAssembly = false;  // .asm text to the output buffer, not the assembler
 
-string sourceFileName;      //name of source file
-string sourceFileBaseName;  //name of source file without extension
+thread_local string sourceFileName;      //name of source file
+thread_local string sourceFileBaseName;  //name of source file without extension
 
-int lCount;
-int lineCount; // source file lineCount
+thread_local int lCount;
+thread_local uint64_t lineCount; // source file lineCount
+thread_local uint64_t tokenCount;
 
-//variable table
-map<string,int> variables;
+//type of each identifier indexed by id, TYPE_NONE if undeclared
+thread_local vector<int> symbolTable;
 
-map<string,int> symbolTable;
+//value of each named constant indexed by id
+thread_local vector<int64_t> constants;
 
-//variables for function parameters
-map<string,int> params;
-int paramCount;
-int base;
+//parameter number of each identifier indexed by id, 0 if not a parameter
+thread_local vector<int> params;
+thread_local vector<int> paramIds; // identifiers currently in params
+thread_local int paramCount;
 
 // global variables from tokens_H
-extern int token;
-extern string value;
-extern string keywordList[];
-
-void expression();
-void block();
+int OS_LINUX      = 0;
+int OS_WINDOWS    = 1;
+thread_local int token;
+thread_local string value;
+thread_local int symbolId;
+
+int expression();
+int block();
 void clearParams();
-void boolExpression();
-bool inTable(string n);
+int boolExpression();
+bool inTable(int id);
 
 //turn debugging on and off
 bool DEBUG_FLAG = false;
 
-//debugging output
-void debug(string d) {
-  if (DEBUG_FLAG) {
-    if (d.find("\n") != string::npos) {
-      d = d.replace(d.find("\n"),2,"");
-    }
-    cout << d << " in source file [line: " << lineCount << "]" << endl;
-  }
-}
+//optimize the IR and the output, off with -O0
+thread_local bool optimize = true;
+
+//print the peephole rule counts, -p
+bool PEEPHOLE_REPORT = false;
+
+//write nasm text and assemble it with nasm instead of in process, -S
+bool ASM_OUTPUT = false;
+
+//run the program in memory instead of writing files, -run
+bool RUN_IN_PROCESS = false;
+
+//run the program with the bytecode interpreter, -vm
+bool INTERPRET = false;
+
+//reuse and keep finished builds, turned off with -nocache
+bool USE_CACHE = true;
+
+//source files named on the command line or in a manifest
+vector<string> sourceFiles;
+
+//files built at a time when there are several, -jN
+int JOBS = 1;
+
+//building several files, each one quietly and without running it
+bool BATCH = false;
+
+//-ftime-report, print where the compile time went
+bool TIME_REPORT = false;
+
+//--metrics=json[:file], write the metrics as json
+bool METRICS_JSON = false;
+string metricsFile;  // stdout when empty
+
+//compiling for b4glCompile, errors are thrown back to it
+thread_local bool RAISE_ERRORS = false;
 
 // report an error
 void error(string s) {
@@ -85,23 +131,20 @@ void error(string s) {
 
 // report error and halt
 void abort(string s) {
-  error(s);
-  if (inputFile != NULL) {
-    inputFile->close();
-    delete inputFile;
-  }
-  if (outputFile != NULL) {
-    outputFile->flush();
-    outputFile->close();
-    delete outputFile;
+  if (RAISE_ERRORS) {
+    B4glDiagnostic diagnostic = {lineCount, s};
+    throw diagnostic;
   }
+  error(s);
+  sourceClose();
   exit(EXIT_FAILURE);
 }
 
-// read a new character from input stream
-void getChar() {
-  debug("getChar()");
-  inputFile->get(look);
+// read a new character from the source buffer
+inline void getChar() {
+  if (sourceCursor < sourceEnd)
+    sourceCursor++;
+  look = sourceLook();
 }
 
 //report what we expected
@@ -121,9 +164,11 @@ void duplicate(string s) {
 
 void dumpSymbolTable() {
   cout << "::Symbol Table::::::::::::::::::::::::" << endl;
-  for(map<string,int>::iterator it=symbolTable.begin(); it!=symbolTable.end();it++) {
-    cout << it->first << TAB << TAB << TAB;
-    switch(it->second) {
+  for (size_t id = 0; id < symbolTable.size(); id++) {
+    if (symbolTable[id] == TYPE_NONE)
+      continue;
+    cout << identifierName(id) << TAB << TAB << TAB;
+    switch(symbolTable[id]) {
     case TYPE_INT:
       cout << "int";
       break;
@@ -142,8 +187,11 @@ void dumpSymbolTable() {
     case TYPE_SUB:
       cout << "subroutine";
       break;
+    case TYPE_CONST:
+      cout << "const " << constants[id];
+      break;
     default:
-      cout << "unknown token " << it->second;
+      cout << "unknown token " << symbolTable[id];
     }
     cout << endl;
   }
@@ -161,26 +209,21 @@ bool isWhite(char c) {
   return (c==' ' || c==TAB || c==CR || c==LF || c=='\'');
 }
 
-//recognize and skip a comment
-void skipComment() {
-  while (look != LF && look != CR) {
-    getChar();
-    if (look == '\'')
-      skipComment();
-  }
-}
-
 //skip over leading white space
 void skipWhite() {
-  while( !inputFile->eof() && isWhite(look)) {
-      if (look == LF)
+  const char *p = sourceCursor;
+  while (p < sourceEnd && isWhite(*p)) {
+    if (*p == '\'') { // comments run to the end of the line
+      while (p < sourceEnd && *p != LF && *p != CR)
+        p++;
+    } else {
+      if (*p == LF)
         lineCount++;
-
-      if (look == '\'')
-        skipComment();
-      else
-        getChar();
+      p++;
+    }
   }
+  sourceCursor = p;
+  look = sourceLook();
 }
 
 //skip over a comma
@@ -192,21 +235,21 @@ void skipComma() {
 }
 
 //find the parameter number
-int paramNumber(string n) {
-  return params[n];
+int paramNumber(int id) {
+  return params[id];
 }
 
 //see if an identifier is a parameter
-bool isParam(string n) {
-  return params.find(n) != params.end();
+bool isParam(int id) {
+  return id < (int)params.size() && params[id] != 0;
 }
 
 //recognize a legal variable type
-bool isVarType(string v) {
-  debug("isVarType("+v+")");
-  if (!inTable(v))
-    abort("Identifier \""+v+"\" not declared");
-  switch(symbolTable[v]) {
+bool isVarType(int id) {
+  TRACE(TRACE_LEVEL_PARSE, "isVarType(%s)", identifierName(id));
+  if (!inTable(id))
+    abort("Identifier \""+identifierName(id)+"\" not declared");
+  switch(symbolTable[id]) {
   case TYPE_CHAR:
   case TYPE_FLOAT:
   case TYPE_INT:
@@ -218,24 +261,30 @@ bool isVarType(string v) {
   }
 }
 
-//output a string with tab
+//add a line to the .asm text, or assemble it
+void writeLine(const string &line) {
+  if (writeAssembly) {
+    outputAppend(line);
+    outputAppend(LF);
+  } else
+    assembleLine(line);
+}
+
+//output a line with tab, it goes through the peephole optimizer
 void emit(string s) {
-  debug("emit("+s+")");
-  s = TAB + s;
-  //printf(s.c_str());
-  outputFile->write(s.c_str(),s.length());
+  TRACE(TRACE_LEVEL_EMIT, "emit(%s)", s);
+  s.insert(s.begin(), TAB);
+  queueLine(move(s));
 }
 
 //output a string with tab and crlf
 void emitLn(string s) {
-  emit(s+"\n");
+  emit(s);
 }
 
 // match a specific input character
 void match (char x) {
-  stringstream ss;
-  ss << "match(" << x << ")";
-  debug(ss.str());
+  TRACE(TRACE_LEVEL_LEX, "match(%c)", x);
 //  newLine();
   if (look == x) {
     getChar();
@@ -251,16 +300,16 @@ void match (char x) {
 
 //generate a unique label
 string newLabel() {
-  stringstream ss;
-  ss << "L" << lCount;
+  string label = "L";
+  appendNumber(label, lCount);
   lCount++;
-  return ss.str();
+  return label;
 }
 
 //post a label to output
 void postLabel(string l) {
-  l+=":\n";
-  outputFile->write(l.c_str(),l.length());
+  l += ':';
+  queueLine(move(l));
 }
 
 // recognize an alpha character
@@ -286,68 +335,54 @@ bool isAlNum(char c) {
 
 // get an identifier
 void getName() {
-  debug("getName()");
+  TRACE(TRACE_LEVEL_LEX, "getName()");
   skipWhite();
   if (!isAlpha(look)) {
     expected("Identifier");
   }
   token = SYM_IDENT;
-  value = "";
-  while (isAlNum(look)) {
-    value+=tolower(look);
-    getChar();
-  }
+  const char *start = sourceCursor;
+  const char *p = start;
+  while (p < sourceEnd && isAlNum(*p))
+    p++;
+  value.assign(start, p - start);
+  for (size_t i = 0; i < value.length(); i++)
+    value[i] = tolower(value[i]);
+  symbolId = intern(value);
+  sourceCursor = p;
+  look = sourceLook();
 }
 
 //get a number
 void getNum() {
-  debug("getNum()");
+  TRACE(TRACE_LEVEL_LEX, "getNum()");
     skipWhite();
   if (!isDigit(look)) {
     expected("Integer");
   }
   token = SYM_DIGIT;
-  value = "";
-  while (isDigit(look)) {
-    value+= look;
-    getChar();
-  }
-}
-
-int tableLookup(string table[], string s, int n) {
-  stringstream ss;
-  ss << "tableLookup(table," << s << "," << n <<")";
-  debug(ss.str());
-  bool found = false;
-  int i = n;
-
-  while (i > 0 && !found) {
-    if (table[i-1].compare(s) == 0) {
-      found = true;
-    } else {
-      i--;
-    }
-  }
-  if (s == "$") {
-    return TYPE_STRING;
-  } else if (s == "#") {
-    return TYPE_FLOAT;
-  }
-  return i;
+  const char *start = sourceCursor;
+  const char *p = start;
+  while (p < sourceEnd && isDigit(*p))
+    p++;
+  value.assign(start, p - start);
+  sourceCursor = p;
+  look = sourceLook();
 }
 
 //get an operator
 void getOp() {
-  debug("getOp()");
+  TRACE(TRACE_LEVEL_LEX, "getOp()");
   skipWhite();
-  value = look;
-  token = tableLookup(operatorList,value, OPERATOR_COUNT) + OPERATOR_OFFSET;
+  value.assign(1, look);
+  token = operatorToken(look);
   getChar();
 }
 
 //get the next input token
 void next() {
-  debug("next()");
+  TRACE(TRACE_LEVEL_LEX, "next()");
+  tokenCount++;
   skipWhite();
   if (isAlpha(look)) {
     getName();
@@ -359,449 +394,350 @@ void next() {
 }
 
 void scan() {
-  debug("scan()");
+  TRACE(TRACE_LEVEL_LEX, "scan()");
   if (token == SYM_IDENT) {
-    token = tableLookup(keywordList, value, KEYWORD_COUNT);
+    token = keywordToken(value);
   }
 }
 
 void matchString(string x) {
-  debug("matchString("+x+")");
+  TRACE(TRACE_LEVEL_LEX, "matchString(%s)", x);
   if (value.compare(x) != 0) {
     expected("\""+x+"\"");
   }
   next();
 }
 
-// init
-void init(string input) {
-  debug("init("+input+")");
+//reset the compiler state and read the first token of the source buffer
+void startParse() {
+  clearIdentifiers();
+  symbolTable.clear();
+  constants.clear();
   clearParams();
+  clearNodes();
   lCount = 0;
   lineCount = 1;
-  inputFile = new ifstream(input);
+  tokenCount = 0;
+  look = sourceLook();
+  next();
+}
 
-  if (!inputFile->good()) {
+// init
+void init(string input) {
+  TRACE(TRACE_LEVEL_PHASE, "init(%s)", input);
+  if (!sourceOpen(input)) {
     abort("failed to open file \""+input+"\"\n \
           does the file exist?\n");
   }
 
-  outputFile = new ofstream(sourceFileBaseName+".asm");
-  getChar();
-  next();
-}
-
-
-//check if character is an addOp
-bool isAddOp(int i) {
-  switch(i) {
-  case OP_ADD:
-  case OP_SUB:
-    return true;
-    break;
-  default:
-    return false;
-    break;
-  }
+  writeAssembly = ASM_OUTPUT;
+  startParse();
 }
 
-//check if character is a multOp
-bool isMultOp(int i) {
-  switch(i) {
-  case OP_MULT:
-  case OP_DIV:
-    return true;
-    break;
-  default:
-    return false;
-    break;
-  }
-}
-
-//recognize a boolean Orop
-bool isOrOp(int c) {
-  switch(c) {
-  case OP_OR:
-  case OP_XOR:
-    return true;
-  default:
-    return false;
-  }
-}
-
-//recognize a relop
-bool isRelOp(int c) {
-  switch(c){
-  case OP_REL_E:
-  case OP_REL_L:
-  case OP_REL_G:
-    return true;
-  default:
-    return false;
-  }
-}
 
 //look for symbol in table
-bool inTable(string n) {
-  return symbolTable.find(n) != symbolTable.end();
+bool inTable(int id) {
+  return id < (int)symbolTable.size() && symbolTable[id] != TYPE_NONE;
 }
 
 //check to see if identifier is in the symbol table
-void checkTable(string n) {
-  if (!inTable(n)) {
-    undefined(n);
+void checkTable(int id) {
+  if (!inTable(id)) {
+    undefined(identifierName(id));
   }
 }
 
 //check for duplicate identifier
-void checkDup(string n) {
-  if (inTable(n))
-    duplicate(n);
+void checkDup(int id) {
+  if (inTable(id))
+    duplicate(identifierName(id));
 }
 
 //add symbol to table
-void addToTable(string n, int type) {
-  checkDup(n);
-  symbolTable[n] = type;
-}
-
-int getTypeFromTable(string n) {
-  checkTable(n);
-  return variables[n];
-}
-
-//load a variable
-void loadVariable(string n) {
-  if (!inTable(n))
-    undefined(n);
-  LoadVar(n);
-}
-
-//parse and translate a math expression
-void factor() {
-  debug("factor()");
-  if (token == OP_PAR_O) {
-    next();
-    boolExpression();
-    matchString(")");
-  } else {
-    if (token == SYM_IDENT) {
-      if (isParam(value)) {
-        loadParam(paramNumber(value));
-      } else {
-        loadVariable(value);
-      }
-    } else if (token == SYM_DIGIT) {
-        LoadConst(value);
-    } else {
-      expected("Math factor");
-    }
-    next();
+void addToTable(int id, int type) {
+  checkDup(id);
+  if (id >= (int)symbolTable.size())
+    symbolTable.resize(identifierCount(), TYPE_NONE);
+  symbolTable[id] = type;
+}
+
+//build a reference to a variable, parameter or named constant
+int variable(int id) {
+  if (isParam(id))
+    return newValueNode(NODE_PARAM, paramNumber(id));
+  if (!inTable(id))
+    undefined(identifierName(id));
+  if (symbolTable[id] == TYPE_CONST)
+    return newValueNode(NODE_CONST, constants[id]);
+  return newValueNode(NODE_VAR, id);
+}
+
+//parse a number into a constant
+int64_t numberValue() {
+  if (token != SYM_DIGIT)
+    expected("Integer");
+  return strtoll(value.c_str(), NULL, 10);
+}
+
+// binding strength of the expression operators, loosest first. Operands
+// of a relation are arithmetic, '!' negates a whole relation and
+// relations don't chain, a second one ends the expression
+const int PREC_NONE     = 0;  // start of a parenthesis or boolean expression
+const int PREC_OR       = 1;  // | ~
+const int PREC_AND      = 2;  // &
+const int PREC_NOT      = 3;  // ! prefix
+const int PREC_RELATION = 4;  // = # <> < > <= >=
+const int PREC_ADD      = 5;  // + -, and a leading sign
+const int PREC_MULT     = 6;  // * /
+
+//precedence of a binary operator token, PREC_NONE if it isn't one
+int precedence(int token) {
+  static const int table[] = {
+    PREC_OR, PREC_OR, PREC_ADD, PREC_ADD, PREC_MULT, PREC_MULT,  // | ~ + - * /
+    PREC_RELATION, PREC_RELATION, PREC_RELATION, PREC_RELATION,  // = # < >
+    PREC_NONE, PREC_NONE, PREC_NONE, PREC_AND                    // ( ) ! &
+  };
+  if (token < OP_OR || token > OP_REL_A)
+    return PREC_NONE;
+  return table[token - OP_OR];
+}
+
+// an operator waiting for its right operand, OP_PAR_O marks a parenthesis
+struct PendingOperator {
+  int op;
+  int precedence;
+};
+
+// the stacks of the expression parser, on the heap so nesting depth costs
+// no native stack
+static thread_local vector<int> operandStack;
+static thread_local vector<PendingOperator> operatorStack;
+
+//replace the top operator and its operands by a node
+void reduce() {
+  PendingOperator o = operatorStack.back();
+  operatorStack.pop_back();
+  int right = operandStack.back();
+  if (o.op == OP_REL_N) {
+    operandStack.back() = newNode(NODE_NOT, 0, right, NO_NODE);
+    return;
   }
+  operandStack.pop_back();
+  int kind = o.precedence == PREC_RELATION ? NODE_COMPARE : NODE_BINARY;
+  operandStack.back() = newNode(kind, o.op, operandStack.back(), right);
 }
 
-//recognize and translate a multiply
-void multiply() {
-  next();
-  factor();
-  PopMul();
-}
-
-//recognize and translate a divide
-void divide() {
-  next();
-  factor();
-  PopDiv();
-}
-
-//get another expression and compare
-void compareExpresion() {
-  expression();
-  PopCompare();
+//precedence of the innermost pending operator, bottom for none
+int pendingPrecedence(size_t base, int bottom) {
+  if (operatorStack.size() == base)
+    return bottom;
+  return operatorStack.back().precedence;
 }
 
-//get the next expression and compare
-void nextExpression() {
+//read a relational operator, some are two tokens
+int relationalOperator() {
+  int op = token;
   next();
-  compareExpresion();
-}
-
-//recognize and translate a relational equals
-void equals() {
-  nextExpression();
-  setEqual();
-}
-
-//recognize and translate a not equals
-void notEqual() {
-  nextExpression();
-  setNEqual();
-}
-
-//recognize and translate a relational less than or equal
-void lessOrEqual() {
-  nextExpression();
-  setLessOrEqual();
-}
-
-//recognize and translate a less than
-void Less() {
-  debug("Less()");
-  next();
-  switch(token) {
-  case OP_REL_E:
-    lessOrEqual();
-    break;
-  case OP_REL_G:
-    notEqual();
-    break;
-  default:
-    compareExpresion();
-    setLess();
-  }
-}
-
-//recognize and translate a greater than
-void Greater() {
-  debug("Greater()");
-  next();
-  if (token == OP_REL_E) {
-    nextExpression();
-    setGreaterOrEqual();
+  if (op == OP_REL_L && token == OP_REL_E) {
+    op = OP_REL_LE;
+  } else if (op == OP_REL_L && token == OP_REL_G) {
+    op = OP_REL_NE;
+  } else if (op == OP_REL_G && token == OP_REL_E) {
+    op = OP_REL_GE;
   } else {
-    compareExpresion();
-    setGreater();
-  }
-}
-
-//parse and translate a relation
-void relation() {
-  debug("relation()");
-  expression();
-  if (isRelOp(token)) {
-    Push();
-    switch(token) {
-    case OP_REL_E:
-      equals();
-      break;
-    case OP_REL_L:
-      Less();
-      break;
-    case OP_REL_G:
-      Greater();
-      break;
-    }
+    return op;
   }
-}
-
-//parse and translate a boolean factor with leading not
-void notFactor() {
-  debug("notFactor()");
-  if (token == OP_REL_N) {
-    next();
-    relation();
-    NotIt();
-  } else {
-    relation();
-  }
-}
-
-//parse and translate a boolean term
-void boolTerm() {
-  debug("boolTerm()");
-  notFactor();
-  while (look == OP_REL_A) {
-    Push();
-    next();
-    notFactor();
-    PopAnd();
-  }
-}
-
-//recognize and translate a boolean or
-void boolOr() {
-  debug("boolOr()");
   next();
-  boolTerm();
-  PopOr();
-}
-
-//recognize and translate a exclusive or
-void boolXor() {
-  debug("boolXor()");
-  next();
-  boolTerm();
-  PopXor();
-}
-
-//parse and translate a boolean expression
-void boolExpression() {
-  debug("boolExpression()");
-  boolTerm();
-  while (isOrOp(token)) {
-    Push();
-    switch(token) {
-    case OP_OR:
-      boolOr();
-      break;
-    case OP_XOR:
-      boolXor();
-      break;
+  return op;
+}
+
+//parse an expression by precedence climbing with explicit stacks, only
+//operators binding at least as tightly as lowest are taken outside of
+//parentheses
+int parseExpression(int lowest) {
+  TRACE(TRACE_LEVEL_PARSE, "parseExpression(%d)", (int64_t)lowest);
+  size_t operandBase = operandStack.size();
+  size_t operatorBase = operatorStack.size();
+  // an arithmetic expression starts out like the operand of a relation
+  int bottom = lowest == PREC_OR ? PREC_NONE : PREC_RELATION;
+  int depth = 0;  // open parentheses
+  for (;;) {
+    // operand, after any prefix
+    int context = pendingPrecedence(operatorBase, bottom);
+    if (token == OP_REL_N && context <= PREC_AND) {
+      next();
+      PendingOperator o = {OP_REL_N, PREC_NOT};
+      operatorStack.push_back(o);
+      continue;
+    }
+    if (token == OP_PAR_O) {
+      next();
+      PendingOperator o = {OP_PAR_O, PREC_NONE};
+      operatorStack.push_back(o);
+      depth++;
+      continue;
+    }
+    if ((token == OP_ADD || token == OP_SUB) && context <= PREC_RELATION) {
+      operandStack.push_back(newValueNode(NODE_CONST, 0)); // leading sign, 0 + x or 0 - x
+    } else {
+      if (token == SYM_IDENT) {
+        operandStack.push_back(variable(symbolId));
+      } else if (token == SYM_DIGIT) {
+        operandStack.push_back(newValueNode(NODE_CONST, numberValue()));
+      } else {
+        expected("Math factor");
+      }
+      next();
     }
-  }
-}
 
-//parse and translate a math term
-void term() {
-  debug("term()");
-  factor();
-  while (isMultOp(token)) {
-    Push();
-    switch(token) {
-    case OP_MULT:
-      multiply();
-      break;
-    case OP_DIV:
-      divide();
+    // closing parentheses, then a binary operator or the end
+    while (token == OP_PAR_C && depth > 0) {
+      while (operatorStack.back().op != OP_PAR_O)
+        reduce();
+      operatorStack.pop_back();
+      depth--;
+      next();
+    }
+    int p = precedence(token);
+    if (p == PREC_NONE || (depth == 0 && p < lowest))
       break;
+    int op = token;
+    if (p == PREC_RELATION) {
+      while (pendingPrecedence(operatorBase, bottom) > PREC_RELATION)
+        reduce();
+      if (pendingPrecedence(operatorBase, bottom) == PREC_RELATION)
+        break;  // relations don't chain
+      op = relationalOperator();
+    } else {
+      while (pendingPrecedence(operatorBase, bottom) >= p)
+        reduce();
+      next();
     }
+    PendingOperator o = {op, p};
+    operatorStack.push_back(o);
   }
+  if (depth > 0)
+    matchString(")");
+  while (operatorStack.size() > operatorBase)
+    reduce();
+  int n = operandStack.back();
+  operandStack.resize(operandBase);
+  return n;
 }
 
-// recognize and translate an add
-void add() {
-  next();
-  term();
-  PopAdd();
-}
-
-// recognize and translate a subtract
-void subtract() {
-  next();
-  term();
-  PopSub();
+//parse and translate an arithmetic expression
+int expression() {
+  return parseExpression(PREC_ADD);
 }
 
-// parse and translate an expression
-void expression() {
-  debug("expression()");
-  if (isAddOp(token)) {
-    Clear();
-  } else {
-    term();
-  }
-  while(isAddOp(token)) {
-    Push();
-    switch (token) {
-    case OP_ADD:
-      add();
-      break;
-    case OP_SUB:
-      subtract();
-      break;
-    }
-  }
+//parse and translate a boolean expression
+int boolExpression() {
+  return parseExpression(PREC_OR);
 }
 
 //recognize and translate an if construct
-void doIf() {
-  debug("doIf()");
+int doIf() {
+  TRACE(TRACE_LEVEL_PARSE, "doIf()");
+  int n = newNode(NODE_IF);
   next();
-  boolExpression();
-  string l1,l2;
-  l1 = newLabel();
-  l2 = l1;
-  branchFalse(l1);
-  block();
+  int condition = boolExpression();
+  int thenBlock = block();
+  int elseBlock = NO_NODE;
   if (token == SYM_ELSE) {
     next();
-    l2 = newLabel();
-    branch(l2);
-    postLabel(l1);
-    block();
+    elseBlock = block();
   }
-  postLabel(l2);
   matchString("endif");
+  nodes[n].a = condition;
+  nodes[n].b = thenBlock;
+  nodes[n].c = elseBlock;
+  return n;
 }
 
 //parse and translate a while statement
-void doWhile() {
-  debug("doWhile()");
+int doWhile() {
+  TRACE(TRACE_LEVEL_PARSE, "doWhile()");
+  int n = newNode(NODE_WHILE);
   next();
-  string l1, l2;
-  l1 = newLabel();
-  l2 = newLabel();
-  postLabel(l1);
-  boolExpression();
-  branchFalse(l2);
-  block();
+  int condition = boolExpression();
+  int body = block();
   matchString("wend");
-  branch(l1);
-  postLabel(l2);
+  nodes[n].a = condition;
+  nodes[n].b = body;
+  return n;
 }
 
 //read a single variable
-void readVar() {
-  debug("readVar()");
+int readVar() {
+  TRACE(TRACE_LEVEL_PARSE, "readVar()");
   checkIdent();
-  checkTable(value);
-  readIt(value);
+  int n;
+  if (isParam(symbolId)) {
+    n = newValueNode(NODE_PARAM, paramNumber(symbolId));
+  } else {
+    checkTable(symbolId);
+    if (symbolTable[symbolId] == TYPE_CONST)
+      abort("Constant "+value+" Cannot be read into");
+    n = newValueNode(NODE_VAR, symbolId);
+  }
   next();
+  return n;
 }
 
 //process a read statement
-void doRead() {
-  debug("doRead");
+int doRead() {
+  TRACE(TRACE_LEVEL_PARSE, "doRead");
+  int n = newNode(NODE_READ);
+  NodeList vars;
   next();
   matchString("(");
-  readVar();
+  vars.add(readVar());
   while (token == OP_COMMA) {
     next();
-    readVar();
+    vars.add(readVar());
   }
   matchString(")");
+  nodes[n].a = vars.first;
+  return n;
 }
 
 //process a write statement
-void doWrite() {
-  debug("doWrite");
-  string name;
+int doWrite() {
+  TRACE(TRACE_LEVEL_PARSE, "doWrite");
+  int n = newNode(NODE_WRITE);
+  NodeList values;
   next();
   matchString("(");
-  name = value;
-  expression();
-  writeIt();
+  values.add(expression());
   while (token == OP_COMMA) {
     next();
-    name = value;
-    expression();
-    writeIt();
+    values.add(expression());
   }
   matchString(")");
+  nodes[n].a = values.first;
+  return n;
 }
 
 
 //parse and translate an assignment statement
-void assignment() {
-  debug("assignment()");
-  if (!isParam(value)) {
-    checkTable(value);
-  }
-  string name = value;
+int assignment() {
+  TRACE(TRACE_LEVEL_PARSE, "assignment()");
+  int n = newNode(NODE_ASSIGN);
+  int target = variable(symbolId);
   next();
   matchString("=");
-  boolExpression();
-  if (isParam(name)) {
-    storeParam(paramNumber(name));
-  } else {
-    StoreVar(name);
-  }
+  int expression = boolExpression();
+  nodes[n].a = target;
+  nodes[n].b = expression;
+  return n;
 }
 
 //clear function params list
 void clearParams() {
-  debug("clearParams()");
-  params.clear();
+  TRACE(TRACE_LEVEL_PARSE, "clearParams()");
+  for (size_t i = 0; i < paramIds.size(); i++)
+    params[paramIds[i]] = 0;
+  paramIds.clear();
   paramCount = 0;
 }
 
@@ -811,36 +747,39 @@ void semi() {
 }
 
 //add a new parameter to the table
-void addParam(string n) {
-  debug("addParam("+n+")");
-  if (isParam(n))
-    duplicate(n);
+void addParam(int id) {
+  TRACE(TRACE_LEVEL_PARSE, "addParam(%s)", identifierName(id));
+  if (isParam(id))
+    duplicate(identifierName(id));
+  if (id >= (int)params.size())
+    params.resize(identifierCount(), 0);
   paramCount++;
-  params[n] = paramCount;
+  params[id] = paramCount;
+  paramIds.push_back(id);
 }
 
 
 //process a formal parameter
 void formalParam() {
-  debug("formalParam()");
-  addParam(value);
+  TRACE(TRACE_LEVEL_PARSE, "formalParam()");
+  addParam(symbolId);
   next();
 }
 
 //get type of symbol
-int typeOf(string n) {
-  debug("typeOf("+n+")");
-  if (isParam(n)) {
+int typeOf(int id) {
+  TRACE(TRACE_LEVEL_PARSE, "typeOf(%s)", identifierName(id));
+  if (isParam(id)) {
     return VAR_PARAM;
-  } else {
-    return symbolTable[n];
-    //return getTypeFromTable(n);
+  } else if (inTable(id)) {
+    return symbolTable[id];
   }
+  return TYPE_NONE;
 }
 
 //process the formal parameter list of a function
-void formalList() {
-  debug("formalList()");
+int formalList() {
+  TRACE(TRACE_LEVEL_PARSE, "formalList()");
   matchString("(");
   if (token != OP_PAR_C) {
     //next();
@@ -851,45 +790,62 @@ void formalList() {
     }
   }
   matchString(")");
-  base = paramCount;
+  int base = paramCount;
   paramCount = paramCount +2;
+  return base;
+}
+
+//parse an expression that must be known at compile time
+int64_t constantExpression() {
+  int n = boolExpression();
+  int64_t v;
+  if (!evaluate(n, v))
+    expected("Constant expression");
+  return v;
+}
+
+//parse the initial value of a declaration, 0 if there is none
+int64_t initialValue() {
+  if (token != OP_REL_E)
+    return 0;
+  next();
+  return constantExpression();
 }
 
-//parse and translate a data declaration
-void locDecl() {  // TODO make dim <var> = <val> work
-  debug("locDecl()");
+//parse and translate a data declaration, an initial value becomes an
+//assignment at the start of the body
+void locDecl(NodeList &inits) {
+  TRACE(TRACE_LEVEL_PARSE, "locDecl()");
   next();
   if (token != SYM_IDENT)
     expected("Variable Name");
 
-  string name = value;
-  string val = "";
-  addToTable(name,TYPE_INT);
+  int id = symbolId;
+  addToTable(id,TYPE_INT);
   next();
-  if (token == OP_REL_E) {
-    next();
-    if (token == OP_SUB) {
-      next();
-      val+= "0-";
-    }
-    val+= value;
-    next();
-  } else {
-   val= "0";
+  bool initialized = token == OP_REL_E;
+  int64_t v = initialValue();
+  addParam(id);
+  if (initialized) {
+    int n = newNode(NODE_ASSIGN);
+    int target = newValueNode(NODE_PARAM, paramNumber(id));
+    int initial = newValueNode(NODE_CONST, v);
+    nodes[n].a = target;
+    nodes[n].b = initial;
+    inits.add(n);
   }
-  addParam(name);
 }
 
 //parse and translate local declarations
-int locDecls() {
-  debug("locDecls");
+int locDecls(NodeList &inits) {
+  TRACE(TRACE_LEVEL_PARSE, "locDecls");
   int n = 0;
   scan();
   while (token == SYM_DIM) {
-    locDecl();
+    locDecl(inits);
     n++;
     while (token == OP_COMMA) {
-      locDecl();
+      locDecl(inits);
       n++;
     }
     semi();
@@ -904,85 +860,86 @@ int locDecls() {
 
 
 //parse and translate a subroutine
-void doSub() {
-  debug("doSub()");
-  string l = newLabel();
-  branch(l);
+int doSub() {
+  TRACE(TRACE_LEVEL_PARSE, "doSub()");
+  int n = newNode(NODE_SUB);
   next();
-  string name = value;
+  int id = symbolId;
 
-  checkDup(name);
-  addToTable(name,SYM_SUB);
+  checkDup(id);
+  addToTable(id,SYM_SUB);
   next();
-  formalList();
-  int locVarCount = locDecls();
-  subProlog(name,locVarCount);
-  block();
-  subEpilog(locVarCount);
-  postLabel(l);
+  int paramCount = formalList();
+  NodeList inits;
+  int locVarCount = locDecls(inits);
+  int body = block();
+  if (inits.first != NO_NODE) {
+    nodes[inits.last].next = nodes[body].a;
+    nodes[body].a = inits.first;
+  }
   matchString("endsub");
   clearParams();
+  nodes[n].value = id;
+  nodes[n].a = body;
+  nodes[n].b = paramCount;
+  nodes[n].c = locVarCount;
+  return n;
 }
 
 //process a parameter
-void param() {
-  debug("param()");
-  expression();
-  Push();
+int param() {
+  TRACE(TRACE_LEVEL_PARSE, "param()");
+  return expression();
 }
 
 //process the parameter list for a subroutine call
 int paramList() {
-  debug("paramList()");
-  int n = 0;
+  TRACE(TRACE_LEVEL_PARSE, "paramList()");
+  NodeList args;
   matchString("(");
   if (token != OP_PAR_C) {
-    param();
-    n++;
+    args.add(param());
     while (token == OP_COMMA) {
       next();
-      param();
-      n++;
+      args.add(param());
     }
   }
   matchString(")");
-  return 8*n;
+  return args.first;
 }
 
 //process a subroutine
-void callSub(string name) {
-  debug("callSub("+name+")");
-  int n;
+int callSub(int id) {
+  TRACE(TRACE_LEVEL_PARSE, "callSub(%s)", identifierName(id));
+  int n = newValueNode(NODE_CALL, id);
   next();
-  n = paramList();
-  call(name);
-  cleanStack(n);
+  int args = paramList();
+  nodes[n].a = args;
+  return n;
 }
 
 //decide if a statement is an assignment or a subroutine call
-void assignmentOrSub() {
-  debug("assigmentOrSub()");
-  int identifierType = typeOf(value);
+int assignmentOrSub() {
+  TRACE(TRACE_LEVEL_PARSE, "assigmentOrSub()");
+  int identifierType = typeOf(symbolId);
   switch(identifierType) {
   case SYM_SUB:
-    callSub(value);
-    //next();
-    break;
+    return callSub(symbolId);
   case TYPE_INT:
   case TYPE_STRING:
   case TYPE_LONG:
   case TYPE_CHAR:
   case TYPE_FLOAT:
   case VAR_PARAM:
-    assignment();
-    break;
+    return assignment();
   default:
     abort("Identifier "+value+" Cannot be used here");
   }
+  return NO_NODE;
 }
 
 bool isTerminator(int i) {
-  if (inputFile->eof()) {
+  if (sourceEof()) {
     return true;
   }
   switch(i) {
@@ -999,28 +956,30 @@ bool isTerminator(int i) {
 }
 
 //parse and translate a block of statements
-void block() {
-  debug("block()");
+int block() {
+  TRACE(TRACE_LEVEL_PARSE, "block()");
+  int n = newNode(NODE_BLOCK);
+  NodeList statements;
   scan();
   while (!isTerminator(token)) {
     switch (token) {
     case SYM_IF:
-      doIf();
+      statements.add(doIf());
       break;
     case SYM_WHILE:
-      doWhile();
+      statements.add(doWhile());
       break;
     case SYM_READ:
-      doRead();
+      statements.add(doRead());
       break;
     case SYM_WRITE:
-      doWrite();
+      statements.add(doWrite());
       break;
     case SYM_SUB:
-      doSub();
+      statements.add(doSub());
       break;
     case SYM_IDENT:
-      assignmentOrSub();
+      statements.add(assignmentOrSub());
       break;
     default:
       abort(value+" not expected");
@@ -1028,179 +987,454 @@ void block() {
     semi();
     scan();
   }
+  nodes[n].a = statements.first;
+  return n;
 }
 
 int getVarType() {
-  debug("getVarType()");
-  if (value == "$")
-    return TYPE_STRING;
-  if (value == "#")
-    return TYPE_FLOAT;
-  return TYPE_INT;
+  TRACE(TRACE_LEVEL_PARSE, "getVarType()");
+  return suffixType(value[0]);
 }
 
-//allocate storage for a static variable
-void allocate(string name, string value) {
-  debug("allocate("+name+","+value+")");
-  stringstream ss;
-  ss << name << ":" << TAB << "DW " << value;
-  emitLn(ss.str());
-}
-
-
-//allocate storage for a variable
-void alloc() {
-  debug("alloc()");
+//parse a declaration of a static variable
+int alloc() {
+  TRACE(TRACE_LEVEL_PARSE, "alloc()");
+  int n = newNode(NODE_DIM);
   next();
   if (token != SYM_IDENT)
     expected("Variable Name");
 
-  string name = value;
-  string val = "";
+  int id = symbolId;
   next();
   int type = getVarType();
 
   if (type != TYPE_INT)
     next();
 
-  addToTable(name,type);
-  if (token == OP_REL_E) {
-    next();
-    if (token == OP_SUB) {
-      next();
-      val+= "0-";
-    }
-    val+= value;
-    next();
-  } else {
-   val= "0";
-  }
-  allocate(name, val);
+  addToTable(id,type);
+  int initial = newValueNode(NODE_CONST, initialValue());
+  nodes[n].value = id;
+  nodes[n].op = type;
+  nodes[n].b = initial;
+  return n;
+}
+
+//parse a named constant, const <name> = <constant expression>
+void constDecl() {
+  TRACE(TRACE_LEVEL_PARSE, "constDecl()");
+  next();
+  if (token != SYM_IDENT)
+    expected("Constant Name");
+
+  int id = symbolId;
+  next();
+  if (token != OP_REL_E)
+    expected("=");
+  int64_t v = initialValue();
+  addToTable(id,TYPE_CONST);
+  if (id >= (int)constants.size())
+    constants.resize(identifierCount(), 0);
+  constants[id] = v;
 }
 
 //parse and translate global declarations
-void topDecls() {
-  debug("topDecls()");
+int topDecls() {
+  TRACE(TRACE_LEVEL_PARSE, "topDecls()");
+  NodeList dims;
   scan();
-  while (token == SYM_DIM) {
-    alloc();
-    while (token == OP_COMMA) {
-      alloc();
+  while (token == SYM_DIM || token == SYM_CONST) {
+    if (token == SYM_CONST) {
+      constDecl();
+      while (token == OP_COMMA)
+        constDecl();
+    } else {
+      dims.add(alloc());
+      while (token == OP_COMMA) {
+        dims.add(alloc());
 
+      }
     }
     semi();
     scan();
   }
+  return dims.first;
   //next();
 }
 
-//parse and translate a program
-void prog() {
+//parse a program into a tree
+int prog() {
   //matchString("b4gl"); //handles program header part
-  debug("prog()");
+  TRACE(TRACE_LEVEL_PHASE, "prog()");
+  int n = newNode(NODE_PROGRAM);
   semi();
-  header();
-  topDecls();
+  int dims = topDecls();
   //matchString("main");
   semi();
-  prolog();
-  block();
+  int mainBlock = block();
   //matchString("endmain");
   //semi();
-  epilog();
-}
-#ifdef __linux
-string exec(string cmd) {  // TODO use _pipe on windows
-  FILE* pipe;
-  pipe = popen(cmd.c_str(), "r");
-  if (!pipe) abort("Could not open file \""+cmd+"\"");
-  char buffer[128];
-  string result = "";
-  while (!feof(pipe)) {
-    if (fgets(buffer,128, pipe) != NULL)
-      result += buffer;
-  }
-  pclose(pipe);
-  return result;
+  nodes[n].a = dims;
+  nodes[n].b = mainBlock;
+  return n;
 }
 
-#else
-string exec(string cmd) {
-  debug("exec("+cmd+")");
-  string tmp = sourceFileBaseName + ".tmp";
-  cmd += " >> "+tmp;
-  system(cmd.c_str());
-  ifstream file (tmp, std::ios::in);
-  string result;
-  if (file) {
-    while (!file.eof())
-      result+=file.get();
-    file.close();
-  }
-  remove(tmp.c_str());
-  return result;
+//run nasm or the linker, show what it printed and stop if it failed
+void runTool(vector<string> args) {
+  ProcessResult tool = runProcess(args, true);
+  metricsChildCpu(tool.cpuSeconds);
+  if (!tool.output.empty())
+    cout << tool.output << flush;
+  if (tool.status < 0)
+    abort("could not run " + args[0]);
+  if (tool.status != 0)
+    abort(args[0] + " failed on \"" + sourceFileName + "\"");
 }
-#endif
 
 void closeFiles() {
-  inputFile->close();
-  outputFile->flush();
-  outputFile->close();
-  delete outputFile;
-  delete inputFile;
+  flushLines();
+  sourceClose();
+  if (writeAssembly) {
+    metricsCount(COUNT_OUTPUT_BYTES, outputSize());
+    bool written = outputWriteFile(sourceFileBaseName + ".asm");
+    outputClear();
+    writeAssembly = false;
+    if (!written)
+      abort("could not write \""+sourceFileBaseName+".asm\"");
+  }
 }
 void compile() {
-  cout << "compiling" << endl;
-  stringstream ss;
+  if (!BATCH)
+    cout << "compiling" << endl;
+  phaseBegin(PHASE_ASSEMBLE);
+  if (!ASM_OUTPUT) {
+    finishAssembly();
+    if (!writeObjectFile(sourceFileBaseName + ".o"))
+      abort("could not write \""+sourceFileBaseName+".o\"");
+    phaseEnd(PHASE_ASSEMBLE);
+    return;
+  }
+  vector<string> args;
+  args.push_back("nasm");
   if (CURRENT_OS == OS_LINUX) {
-    ss << "nasm -felf64 -o " << sourceFileBaseName << ".o ";
+    args.push_back("-felf64");
+    args.push_back("-o");
+    args.push_back(sourceFileBaseName + ".o");
   } else if (CURRENT_OS == OS_WINDOWS) {
-    ss << "nasm -f win64 -o " << sourceFileBaseName << ".obj ";
+    args.push_back("-fwin64");
+    args.push_back("-o");
+    args.push_back(sourceFileBaseName + ".obj");
   }
-  ss << sourceFileBaseName << ".asm";
-  cout << exec(ss.str()) << endl;
+  args.push_back(sourceFileBaseName + ".asm");
+  runTool(args);
+  phaseEnd(PHASE_ASSEMBLE);
 }
 
 void link() {
-  cout << "linking" << endl;
-  stringstream ss;
+  if (!BATCH)
+    cout << "linking" << endl;
+  phaseBegin(PHASE_LINK);
+  if (!ASM_OUTPUT) {
+    if (!writeExecutable(sourceFileBaseName))
+      abort("could not write \""+sourceFileBaseName+"\"");
+    phaseEnd(PHASE_LINK);
+    return;
+  }
+  vector<string> args;
   if (CURRENT_OS == OS_LINUX) {
-    ss << "gcc " << sourceFileBaseName << ".o -o " << sourceFileBaseName;
+    // the code uses 32 bit absolute addresses
+    args.push_back("gcc");
+    args.push_back("-no-pie");
+    args.push_back(sourceFileBaseName + ".o");
+    args.push_back("-o");
+    args.push_back(sourceFileBaseName);
   } else if (CURRENT_OS == OS_WINDOWS) {
-    ss << "GoLink /console msvcrt.dll /entry main ";
-    ss << sourceFileBaseName << ".obj";
+    args.push_back("GoLink");
+    args.push_back("/console");
+    args.push_back("msvcrt.dll");
+    args.push_back("/entry");
+    args.push_back("main");
+    args.push_back(sourceFileBaseName + ".obj");
   }
-  cout << exec(ss.str()) << endl;
+  runTool(args);
+  phaseEnd(PHASE_LINK);
 }
 
-void execute() {
+//run the compiled program on the compiler's terminal, returns its exit code
+int execute() {
   cout << "running" << endl << endl;
-  stringstream ss;
-  if (CURRENT_OS == OS_LINUX) {
-    ss << "./";
+  string program = sourceFileBaseName;
+  if (CURRENT_OS == OS_LINUX && program.find('/') == string::npos)
+    program = "./" + program;
+  phaseBegin(PHASE_RUN);
+  ProcessResult run = runProcess(vector<string>(1, program), false);
+  if (run.status < 0)
+    abort("could not run \"" + program + "\"");
+  metricsChildCpu(run.cpuSeconds);
+  phaseEnd(PHASE_RUN);
+  cout << endl;
+  return run.status;
+}
+
+//what -d, -p, -ftime-report and --metrics ask for once the program is
+//compiled, a batch has no single program to dump
+void report() {
+  if (DEBUG_FLAG && !BATCH) {
+    dumpSymbolTable();
+    dumpIr();
   }
-  ss << sourceFileBaseName;
-  cout << exec(ss.str()) << endl;
+  if (PEEPHOLE_REPORT)
+    peepholeReport();
+  if (TIME_REPORT)
+    metricsReport();
+  if (METRICS_JSON)
+    metricsJson(metricsFile);
+}
+
+//the files a build leaves next to the source, what the cache keeps
+vector<string> buildFiles() {
+  vector<string> suffixes;
+  if (ASM_OUTPUT)
+    suffixes.push_back(".asm");
+  if (CURRENT_OS == OS_WINDOWS) {
+    suffixes.push_back(".obj");
+    suffixes.push_back(".exe");
+  } else {
+    suffixes.push_back(".o");
+    suffixes.push_back("");
+  }
+  return suffixes;
+}
+
+//the flags that change what a build makes, part of its cache key
+string buildSettings(int argc, char* argv[]) {
+  stringstream settings;
+  settings << CURRENT_OS;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-')
+      continue;
+    if (argv[i][1] == 'f' || argv[i][1] == '-')
+      continue;  // -ftime-report and --metrics only measure
+    if (argv[i][1] == 'j') {
+      if (argv[i][2] == 0)
+        i++;  // -j N
+      continue;
+    }
+    settings << ' ' << argv[i];
+  }
+  return settings.str();
+}
+
+//key of the build in the cache, "" when it can't come from there: the run
+//modes make no files and -d and -p want to see the compilation
+string buildKey(string settings) {
+  if (!USE_CACHE || RUN_IN_PROCESS || INTERPRET || DEBUG_FLAG || PEEPHOLE_REPORT)
+    return "";
+  phaseBegin(PHASE_CACHE);
+  string key = cacheKey(sourceFileName, settings);
+  phaseEnd(PHASE_CACHE);
+  return key;
+}
+
+//copy the cached build into place, false if there is none
+bool restoreBuild(string key, const vector<string> &files) {
+  if (key.empty())
+    return false;
+  phaseBegin(PHASE_CACHE);
+  bool restored = cacheRestore(key, sourceFileBaseName, files);
+  phaseEnd(PHASE_CACHE);
+  return restored;
 }
 
+void setSourceFile(string name) {
+  sourceFileName = name;
+  sourceFileBaseName = sourceFileName.substr(0,sourceFileName.find_last_of('.'));
+}
+
+//parse the source file into IR, optimized unless -O0
+void frontEnd() {
+  phaseBegin(PHASE_PARSE);
+  init(sourceFileName);
+  int program = prog(); //parse program into a tree
+  phaseEnd(PHASE_PARSE);
+  metricsCount(COUNT_TOKENS, tokenCount);
+  metricsCount(COUNT_SYMBOLS, symbolTable.size());
+  phaseBegin(PHASE_IR);
+  buildIr(program);     //lower it to IR
+  phaseEnd(PHASE_IR);
+  if (optimize) {
+    phaseBegin(PHASE_OPTIMIZE);
+    optimizeIr();   //fold and propagate constants, drop dead code
+    phaseEnd(PHASE_OPTIMIZE);
+  }
+}
+
+//translate the IR to assembly, then close input and output files
+void codeGen() {
+  phaseBegin(PHASE_CODEGEN);
+  generate();
+  closeFiles();
+  phaseEnd(PHASE_CODEGEN);
+  metricsCount(COUNT_LABELS, lCount);
+}
+
+//assemble and link what generate() wrote, then add the build to the cache
+void backEnd(string key, const vector<string> &files) {
+  if (!key.empty()) {
+    // only what this build makes may go into the cache
+    for (size_t i = 0; i < files.size(); i++)
+      if (files[i] != ".asm")
+        remove((sourceFileBaseName + files[i]).c_str());
+  }
+  compile();    // invoke assembler
+  link();       // invoke the linker
+  if (!key.empty()) {
+    phaseBegin(PHASE_CACHE);
+    cacheStore(key, sourceFileBaseName, files);
+    phaseEnd(PHASE_CACHE);
+  }
+}
+
+// a file of a batch on its way through the stages
+struct BatchFile {
+  string name;
+  string key;
+  bool toolsPending;   // generated, nasm and the linker still to run
+};
+
+// files of the batch that failed to build
+static atomic<int> batchFailures(0);
+
+//report the error that stopped a file of a batch, the others carry on
+void batchError(string name, const B4glDiagnostic &diagnostic) {
+  sourceClose();
+  printf("\nError: %s in %s\n", diagnostic.message.c_str(), name.c_str());
+  fflush(stdout);
+  batchFailures++;
+}
+
+//compile one file of a batch, every file gets a thread of its own so the
+//thread local compiler state starts out fresh. Running the external tools
+//is left to batchTools, so they can overlap the next file's compilation
+void batchBuild(BatchFile *file, string settings, bool optimizeAll) {
+  RAISE_ERRORS = true;
+  optimize = peepholeEnabled = optimizeAll;
+  file->toolsPending = false;
+  try {
+    setSourceFile(file->name);
+    file->key = buildKey(settings);
+    vector<string> files = buildFiles();
+    bool cached = restoreBuild(file->key, files);
+    if (!cached) {
+      frontEnd();
+      codeGen();
+      if (ASM_OUTPUT) {
+        file->toolsPending = true;
+        return;
+      }
+      backEnd(file->key, files);
+    }
+    printf("%s%s\n", file->name.c_str(), cached ? " (cached)" : "");
+  } catch (const B4glDiagnostic &diagnostic) {
+    batchError(file->name, diagnostic);
+  }
+}
+
+//assemble and link a file of a batch with nasm and the linker
+void batchTools(BatchFile file) {
+  RAISE_ERRORS = true;
+  try {
+    setSourceFile(file.name);
+    backEnd(file.key, buildFiles());
+    printf("%s\n", file.name.c_str());
+  } catch (const B4glDiagnostic &diagnostic) {
+    batchError(file.name, diagnostic);
+  }
+}
+
+//build every source file, JOBS of them at a time, without running them.
+//A file that fails doesn't stop the others, the number that failed is
+//returned
+int batch(string settings) {
+  atomic<size_t> next(0);
+  bool optimizeAll = optimize;
+  vector<thread> workers;
+  for (int w = 0; w < JOBS && w < (int)sourceFiles.size(); w++) {
+    workers.push_back(thread([&]() {
+      thread tools;  // the previous file's nasm and linker
+      for (size_t i = next++; i < sourceFiles.size(); i = next++) {
+        BatchFile file;
+        file.name = sourceFiles[i];
+        thread build(batchBuild, &file, settings, optimizeAll);
+        build.join();
+        if (file.toolsPending) {
+          if (tools.joinable())
+            tools.join();
+          tools = thread(batchTools, file);
+        }
+      }
+      if (tools.joinable())
+        tools.join();
+    }));
+  }
+  for (size_t w = 0; w < workers.size(); w++)
+    workers[w].join();
+  return batchFailures;
+}
+
+#ifndef B4GL_LIBRARY
 int main(int argc, char* argv[]) {
   if (argc < 2) {
     std::cerr << "no parameters specified" << std::endl;
     return 1;
   }
   parseArgs(argc, argv);
-  //sourceFileName = argv[1];
-  //sourceFileBaseName = sourceFileName.substr(0,sourceFileName.find_last_of('.'));
-  init(sourceFileName);
-  prog();       //parse program into 8086
-  closeFiles(); // close input and output files
-  compile();    // invoke assembler
-  link();       // invoke the linker
-  execute();    // execute the compile program
-
-  if (DEBUG_FLAG) {
-  dumpSymbolTable();
+  if (RUN_IN_PROCESS + ASM_OUTPUT + INTERPRET > 1)
+    abort("only one of -run, -S and -vm can be used");
+  if (CURRENT_OS == OS_WINDOWS && !RUN_IN_PROCESS && !INTERPRET)
+    ASM_OUTPUT = true; // there is no COFF writer, nasm makes the .obj
+  if (sourceFiles.empty())
+    abort("no source file specified");
+  string settings = buildSettings(argc, argv);
+  if (sourceFiles.size() > 1) {
+    if (RUN_IN_PROCESS || INTERPRET)
+      abort("-run and -vm take a single source file");
+    BATCH = true;
+    int failures = batch(settings);
+    report();
+    return failures > 0 ? EXIT_FAILURE : 0;
   }
-  return 0;
+  setSourceFile(sourceFiles[0]);
+  string key = buildKey(settings);
+  vector<string> files = buildFiles();
+  if (restoreBuild(key, files)) {
+    cout << "cached" << endl;
+    int status = execute();
+    report();
+    return status;
+  }
+  frontEnd();
+  if (INTERPRET) {
+    phaseBegin(PHASE_CODEGEN);
+    closeFiles();
+    buildBytecode();
+    phaseEnd(PHASE_CODEGEN);
+    phaseBegin(PHASE_RUN);
+    interpret();
+    phaseEnd(PHASE_RUN);
+    report();
+    return 0;
+  }
+  codeGen();
+  if (RUN_IN_PROCESS) {
+    phaseBegin(PHASE_ASSEMBLE);
+    finishAssembly();
+    phaseEnd(PHASE_ASSEMBLE);
+    report();      // the program exits the process, so report first
+    runInProcess();
+  }
+  backEnd(key, files);
+  int status = execute();    // execute the compile program
+  report();
+  return status;
 }
-
+#endif // B4GL_LIBRARY
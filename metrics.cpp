@@ -0,0 +1,139 @@
+#include "metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+#ifdef __linux
+#include <sys/resource.h>
+#include <time.h>
+#else
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+using namespace std;
+
+void abort(string);
+
+bool METRICS = false;
+
+static const char *phaseNames[PHASE_COUNT] = {
+  "cache", "parse", "ir", "optimize", "codegen", "assemble", "link", "run"
+};
+
+static const char *counterNames[COUNT_COUNT] = {
+  "tokens", "symbols", "labels", "instructions", "output_bytes"
+};
+
+// nanoseconds, summed over every thread
+static atomic<uint64_t> phaseWall[PHASE_COUNT];
+static atomic<uint64_t> phaseCpu[PHASE_COUNT];
+static atomic<uint64_t> counters[COUNT_COUNT];
+
+static thread_local uint64_t wallStart;
+static thread_local uint64_t cpuStart;
+static thread_local int currentPhase = -1;
+
+static uint64_t wallNow() {
+  return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//cpu time used by the calling thread
+static uint64_t cpuNow() {
+#ifdef __linux
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+  FILETIME created, exited, kernel, user;
+  GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user);
+  uint64_t ticks = ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime)
+                 + ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+  return ticks * 100;
+#endif
+}
+
+//most memory the compiler has had resident, in bytes
+static uint64_t peakRss() {
+#ifdef __linux
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)usage.ru_maxrss * 1024;
+#else
+  PROCESS_MEMORY_COUNTERS memory;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory)))
+    return 0;
+  return memory.PeakWorkingSetSize;
+#endif
+}
+
+void phaseBegin(int phase) {
+  if (!METRICS)
+    return;
+  currentPhase = phase;
+  wallStart = wallNow();
+  cpuStart = cpuNow();
+}
+
+void phaseEnd(int phase) {
+  if (!METRICS)
+    return;
+  phaseWall[phase] += wallNow() - wallStart;
+  phaseCpu[phase] += cpuNow() - cpuStart;
+  currentPhase = -1;
+}
+
+void metricsChildCpu(double seconds) {
+  if (METRICS && currentPhase >= 0)
+    phaseCpu[currentPhase] += (uint64_t)(seconds * 1e9);
+}
+
+void metricsCount(int counter, uint64_t n) {
+  if (METRICS)
+    counters[counter] += n;
+}
+
+static double milliseconds(uint64_t nanoseconds) {
+  return nanoseconds / 1e6;
+}
+
+void metricsReport() {
+  printf("::Time report:::::::::::::::::::::::::\n");
+  printf("%-16s %10s %10s\n", "phase", "wall ms", "cpu ms");
+  uint64_t wall = 0, cpu = 0;
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    printf("%-16s %10.3f %10.3f\n", phaseNames[p], milliseconds(phaseWall[p]), milliseconds(phaseCpu[p]));
+    wall += phaseWall[p];
+    cpu += phaseCpu[p];
+  }
+  printf("%-16s %10.3f %10.3f\n", "total", milliseconds(wall), milliseconds(cpu));
+  for (int c = 0; c < COUNT_COUNT; c++)
+    printf("%-16s %10llu\n", counterNames[c], (unsigned long long)counters[c].load());
+  printf("%-16s %10llu\n", "peak_rss_kb", (unsigned long long)(peakRss() / 1024));
+  printf("::::::::::::::::::::::::::::::::::::::\n");
+}
+
+void metricsJson(string fileName) {
+  stringstream json;
+  json << "{\"phases\":{";
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    json << (p > 0 ? "," : "") << '"' << phaseNames[p] << "\":{\"wall_ms\":"
+         << milliseconds(phaseWall[p]) << ",\"cpu_ms\":" << milliseconds(phaseCpu[p]) << '}';
+  }
+  json << "},\"counters\":{";
+  for (int c = 0; c < COUNT_COUNT; c++)
+    json << (c > 0 ? "," : "") << '"' << counterNames[c] << "\":" << counters[c].load();
+  json << "},\"peak_rss_bytes\":" << peakRss() << "}\n";
+  if (fileName.empty()) {
+    fputs(json.str().c_str(), stdout);
+    return;
+  }
+  ofstream file(fileName.c_str());
+  if (!file)
+    abort("could not write \"" + fileName + "\"");
+  file << json.str();
+}
@@ -0,0 +1,56 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <stdint.h>
+
+// where the compile time goes, for -ftime-report and --metrics=json
+//
+// each phase adds up its wall clock time and the cpu time of the thread
+// running it, plus that of the tools it started. Counters add up what the
+// compiler made. In a batch the files are summed, so cpu time can exceed
+// wall time when files are built in parallel.
+
+enum MetricsPhase {
+  PHASE_CACHE,      // hashing the source, restoring and storing builds
+  PHASE_PARSE,      // init() and prog(), reading the source into a tree
+  PHASE_IR,         // lowering the tree to IR
+  PHASE_OPTIMIZE,   // optimizeIr()
+  PHASE_CODEGEN,    // register allocation, emission and peephole
+  PHASE_ASSEMBLE,   // the assembler, in process or nasm
+  PHASE_LINK,       // the linker, in process or gcc/GoLink
+  PHASE_RUN,        // running the program, natively or in the vm
+  PHASE_COUNT
+};
+
+enum MetricsCounter {
+  COUNT_TOKENS,        // tokens read by the lexer
+  COUNT_SYMBOLS,       // global symbols declared
+  COUNT_LABELS,        // labels made with newLabel (lCount)
+  COUNT_INSTRUCTIONS,  // instructions written after the peephole optimizer
+  COUNT_OUTPUT_BYTES,  // bytes of .asm, object and executable written
+  COUNT_COUNT
+};
+
+//true when a report was asked for, nothing is measured otherwise
+extern bool METRICS;
+
+//start timing phase on this thread
+void phaseBegin(int phase);
+
+//stop timing phase on this thread and add it up
+void phaseEnd(int phase);
+
+//add cpu time spent by a child process to the phase running on this thread
+void metricsChildCpu(double seconds);
+
+//add n to a counter
+void metricsCount(int counter, uint64_t n);
+
+//print the human readable report, -ftime-report
+void metricsReport();
+
+//write the metrics as json, to stdout when fileName is empty
+void metricsJson(std::string fileName);
+
+#endif // METRICS_H
@@ -0,0 +1,134 @@
+#include "outputBuffer.h"
+#include "trace.h"
+
+#include <string.h>
+#include <vector>
+
+#ifdef __linux
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+using namespace std;
+
+static const size_t CHUNK_SIZE = 1 << 20;
+
+struct Chunk {
+  vector<char> bytes;  // CHUNK_SIZE long, never resized
+  size_t used;
+};
+
+static thread_local vector<Chunk> chunks;
+
+static void newChunk() {
+  chunks.push_back(Chunk());
+  chunks.back().bytes.resize(CHUNK_SIZE);
+  chunks.back().used = 0;
+}
+
+void outputAppend(const char *text, size_t length) {
+  while (length > 0) {
+    if (chunks.empty() || chunks.back().used == CHUNK_SIZE)
+      newChunk();
+    Chunk &c = chunks.back();
+    size_t n = CHUNK_SIZE - c.used < length ? CHUNK_SIZE - c.used : length;
+    memcpy(&c.bytes[c.used], text, n);
+    c.used += n;
+    text += n;
+    length -= n;
+  }
+}
+
+void outputAppend(const string &text) {
+  outputAppend(text.data(), text.size());
+}
+
+void outputAppend(char c) {
+  if (chunks.empty() || chunks.back().used == CHUNK_SIZE)
+    newChunk();
+  chunks.back().bytes[chunks.back().used++] = c;
+}
+
+size_t outputSize() {
+  size_t size = 0;
+  for (size_t i = 0; i < chunks.size(); i++)
+    size += chunks[i].used;
+  return size;
+}
+
+string outputContents() {
+  string text;
+  text.reserve(outputSize());
+  for (size_t i = 0; i < chunks.size(); i++)
+    text.append(&chunks[i].bytes[0], chunks[i].used);
+  return text;
+}
+
+#ifdef __linux
+bool outputWriteFile(string fileName) {
+  TRACE(TRACE_LEVEL_PHASE, "outputWriteFile(%s) %d bytes", fileName, (int64_t)outputSize());
+  int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0)
+    return false;
+  vector<struct iovec> blocks;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    struct iovec block = {&chunks[i].bytes[0], chunks[i].used};
+    if (block.iov_len > 0)
+      blocks.push_back(block);
+  }
+  // writev may stop part way, carry on from where it got to
+  size_t first = 0;
+  while (first < blocks.size()) {
+    int count = blocks.size() - first < IOV_MAX ? (int)(blocks.size() - first) : IOV_MAX;
+    ssize_t n = writev(fd, &blocks[first], count);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return false;
+    }
+    while (first < blocks.size() && (size_t)n >= blocks[first].iov_len)
+      n -= blocks[first++].iov_len;
+    if (first < blocks.size()) {
+      blocks[first].iov_base = (char *)blocks[first].iov_base + n;
+      blocks[first].iov_len -= n;
+    }
+  }
+  return close(fd) == 0;
+}
+
+#else
+bool outputWriteFile(string fileName) {
+  TRACE(TRACE_LEVEL_PHASE, "outputWriteFile(%s) %d bytes", fileName, (int64_t)outputSize());
+  ofstream file(fileName.c_str());
+  for (size_t i = 0; i < chunks.size(); i++)
+    file.write(&chunks[i].bytes[0], chunks[i].used);
+  file.close();
+  return !file.fail();
+}
+#endif
+
+void outputClear() {
+  if (chunks.size() > 1)
+    chunks.resize(1);
+  if (!chunks.empty())
+    chunks[0].used = 0;
+}
+
+void appendNumber(string &s, int64_t value) {
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  do {
+    *--p = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (value < 0)
+    *--p = '-';
+  s.append(p, digits + sizeof(digits) - p);
+}
@@ -0,0 +1,34 @@
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <string>
+#include <stdint.h>
+
+// the .asm text being written
+//
+// lines are appended to a list of large chunks, a chunk is never moved or
+// grown once made so appending never copies what is already there. The
+// whole text goes out with one write when code generation is done, or is
+// handed to the library caller as a string.
+
+//append length bytes of text
+void outputAppend(const char *text, size_t length);
+void outputAppend(const std::string &text);
+void outputAppend(char c);
+
+//bytes appended since the last outputClear
+size_t outputSize();
+
+//everything appended, as one string
+std::string outputContents();
+
+//write everything appended to fileName, false if it couldn't be written
+bool outputWriteFile(std::string fileName);
+
+//drop what was appended, the first chunk is kept for the next file
+void outputClear();
+
+//append value in decimal to s, without going through a stream
+void appendNumber(std::string &s, int64_t value);
+
+#endif // OUTPUTBUFFER_H
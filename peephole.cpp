@@ -0,0 +1,695 @@
+#include "peephole.h"
+#include "trace.h"
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+extern void writeLine(const string &);
+extern int CURRENT_OS;
+extern int OS_LINUX;
+extern int OS_WINDOWS;
+
+thread_local bool peepholeEnabled = true;
+
+struct AsmLine {
+  string text;            // as emitted, rebuilt when a rule changes the line
+  string label;           // set for label lines
+  string op;              // mnemonic in lower case, empty unless an instruction
+  vector<string> args;
+  bool deleted;
+};
+
+static thread_local vector<AsmLine> lines;
+static thread_local map<string, size_t> labelLine;   // where each queued label is
+
+// how far the look ahead for live registers and flags goes
+static const int LOOK_AHEAD = 256;
+// passes over one function before giving up on reaching a fixed point
+static const int MAX_PASSES = 8;
+
+/////////////////////////////////////////////////////
+// registers, indexed in x86-64 encoding order
+/////////////////////////////////////////////////////
+
+static const char *registerNames[4][16] = {
+  {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+   "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"},
+  {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+   "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+  {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+   "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+  {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+   "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"}
+};
+
+const int SIZE_64 = 0;
+const int SIZE_32 = 1;
+const int SIZE_16 = 2;
+const int SIZE_8  = 3;
+
+const int RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5;
+const int RSI = 6, RDI = 7, R8 = 8, R9 = 9, R10 = 10, R11 = 11;
+const int R12 = 12, R13 = 13, R14 = 14, R15 = 15;
+
+static unsigned bit(int r) {
+  return 1u << r;
+}
+
+//register index of a name, -1 if it isn't one, size set to SIZE_*
+static int registerOf(const string &name, int &size) {
+  for (size = 0; size < 4; size++)
+    for (int r = 0; r < 16; r++)
+      if (name == registerNames[size][r])
+        return r;
+  size = SIZE_8;
+  if (name == "ah") return RAX;
+  if (name == "ch") return RCX;
+  if (name == "dh") return RDX;
+  if (name == "bh") return RBX;
+  return -1;
+}
+
+static int registerOf(const string &name) {
+  int size;
+  return registerOf(name, size);
+}
+
+static bool isRegister(const string &arg) {
+  return registerOf(arg) >= 0;
+}
+
+static bool isRegister64(const string &arg) {
+  int size;
+  return registerOf(arg, size) >= 0 && size == SIZE_64;
+}
+
+static bool isMemory(const string &arg) {
+  return arg.find('[') != string::npos;
+}
+
+//true for a decimal constant, its value goes to value
+static bool isImmediate(const string &arg, int64_t &value) {
+  if (arg.empty())
+    return false;
+  char *end;
+  value = strtoll(arg.c_str(), &end, 10);
+  return *end == '\0' && (isdigit((unsigned char)arg[0]) || arg[0] == '-');
+}
+
+static bool isWordChar(char c) {
+  return isalnum((unsigned char)c) || c == '_';
+}
+
+//registers named anywhere in an operand
+static unsigned registersIn(const string &arg) {
+  unsigned set = 0;
+  size_t i = 0;
+  while (i < arg.size()) {
+    if (!isWordChar(arg[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < arg.size() && isWordChar(arg[i]))
+      i++;
+    int r = registerOf(arg.substr(start, i - start));
+    if (r >= 0)
+      set |= bit(r);
+  }
+  return set;
+}
+
+//registers used to form the address of a memory operand
+static unsigned addressRegisters(const string &arg) {
+  return isMemory(arg) ? registersIn(arg) : 0;
+}
+
+/////////////////////////////////////////////////////
+// what instructions do
+/////////////////////////////////////////////////////
+
+static bool isConditionalJump(const string &op) {
+  return op.size() > 1 && op[0] == 'j' && op != "jmp";
+}
+
+static bool readsFlags(const string &op) {
+  return isConditionalJump(op) || op.compare(0, 3, "set") == 0 ||
+         op.compare(0, 4, "cmov") == 0 || op == "adc" || op == "sbb";
+}
+
+static bool writesFlags(const string &op) {
+  return op == "cmp" || op == "test" || op == "add" || op == "sub" ||
+         op == "and" || op == "or" || op == "xor" || op == "neg" ||
+         op == "inc" || op == "dec" || op == "imul" || op == "idiv" ||
+         op == "adc" || op == "sbb";
+}
+
+//true for a destination that only partly replaces its register
+static bool isPartial(const string &arg) {
+  int size;
+  return registerOf(arg, size) >= 0 && (size == SIZE_16 || size == SIZE_8);
+}
+
+//true if the instruction is understood well enough to look past
+static bool isKnown(const AsmLine &l) {
+  static const char *known[] = {
+    "mov", "movzx", "movsx", "movsxd", "lea", "add", "sub", "and", "or",
+    "xor", "imul", "cmp", "test", "not", "neg", "inc", "dec", "push", "pop",
+    "cqo", "idiv", "call", "syscall"
+  };
+  for (size_t k = 0; k < sizeof(known) / sizeof(known[0]); k++)
+    if (l.op == known[k])
+      return true;
+  return l.op.compare(0, 3, "set") == 0;
+}
+
+//true for a call into the C library rather than a compiled subroutine,
+//subroutines take their arguments on the stack
+static bool isLibraryCall(const AsmLine &l) {
+  return l.args.size() == 1 && (l.args[0] == "_write" || l.args[0] == "_read" || l.args[0] == "exit");
+}
+
+//registers an instruction reads
+static unsigned reads(const AsmLine &l) {
+  const string &op = l.op;
+  unsigned set = 0;
+  for (size_t a = 1; a < l.args.size(); a++)
+    set |= registersIn(l.args[a]);
+  if (l.args.empty())
+    ;
+  else if (op == "mov" || op == "movzx" || op == "movsx" || op == "movsxd" || op == "lea" || op == "pop")
+    set |= addressRegisters(l.args[0]) | (isPartial(l.args[0]) ? registersIn(l.args[0]) : 0);
+  else if (op == "xor" && l.args.size() == 2 && l.args[0] == l.args[1] && isRegister(l.args[0]))
+    set = 0;  // zeroing idiom
+  else if (op.compare(0, 3, "set") == 0)
+    set |= registersIn(l.args[0]);
+  else
+    set |= registersIn(l.args[0]);
+  if (op == "push" || op == "pop" || op == "call")
+    set |= bit(RSP);
+  if (op == "cqo")
+    set |= bit(RAX);
+  if (op == "idiv")
+    set |= bit(RAX) | bit(RDX);
+  if (op == "call" && isLibraryCall(l))  // arguments of the windows convention
+    set |= bit(RCX) | bit(RDX) | bit(R8) | bit(R9);
+  if (op == "syscall")
+    set |= bit(RAX) | bit(RDI) | bit(RSI) | bit(RDX) | bit(R10) | bit(R8) | bit(R9);
+  return set;
+}
+
+//registers an instruction overwrites
+static unsigned writes(const AsmLine &l) {
+  const string &op = l.op;
+  unsigned set = 0;
+  if (!l.args.empty() && isRegister(l.args[0]) && op != "cmp" && op != "test" && op != "push")
+    set |= registersIn(l.args[0]);
+  if (op == "push" || op == "pop" || op == "call")
+    set |= bit(RSP);
+  if (op == "cqo")
+    set |= bit(RDX);
+  if (op == "idiv")
+    set |= bit(RAX) | bit(RDX);
+  if (op == "call" && isLibraryCall(l))
+    set |= bit(RAX) | bit(RCX) | bit(RDX) | bit(R8) | bit(R9) | bit(R10) | bit(R11);
+  else if (op == "call")  // subroutines only keep r12 to r15
+    set |= bit(RAX) | bit(RBX) | bit(RCX) | bit(RDX) | bit(RSI) | bit(RDI) |
+           bit(R8) | bit(R9) | bit(R10) | bit(R11);
+  if (op == "syscall")
+    set |= bit(RAX) | bit(RCX) | bit(R11);
+  return set;
+}
+
+/////////////////////////////////////////////////////
+// the queued lines
+/////////////////////////////////////////////////////
+
+static AsmLine parseLine(string line) {
+  AsmLine l;
+  l.text.swap(line);
+  l.deleted = false;
+  const string &text = l.text;
+  size_t b = text.find_first_not_of(" \t");
+  if (b == string::npos || text.find('"') != string::npos)
+    return l;  // blank or data holding a string
+  string s = text.substr(b, text.find(';') - b);
+  s.erase(s.find_last_not_of(" \t") + 1);
+  if (!s.empty() && s[s.size() - 1] == ':' && s.find_first_of(" \t") == string::npos) {
+    l.label = s.substr(0, s.size() - 1);
+    return l;
+  }
+  if (s.find(':') != string::npos)
+    return l;  // data definition
+  size_t space = s.find_first_of(" \t");
+  string op = s.substr(0, space);
+  for (size_t i = 0; i < op.size(); i++)
+    op[i] = tolower(op[i]);
+  if (op == "section" || op == "global" || op == "extern")
+    return l;
+  l.op = op;
+  if (space == string::npos)
+    return l;
+  // operands are split at commas outside of brackets
+  int depth = 0;
+  string arg;
+  for (size_t i = space; i <= s.size(); i++) {
+    char c = i < s.size() ? s[i] : ',';
+    if (c == '[')
+      depth++;
+    else if (c == ']')
+      depth--;
+    if (c == ',' && depth == 0) {
+      size_t first = arg.find_first_not_of(" \t");
+      if (first != string::npos)
+        l.args.push_back(arg.substr(first, arg.find_last_not_of(" \t") - first + 1));
+      arg.clear();
+    } else {
+      arg += c;
+    }
+  }
+  return l;
+}
+
+//write an instruction back out after a rule changed it
+static void rebuild(AsmLine &l, string op, vector<string> args) {
+  l.op = op;
+  l.args = args;
+  l.text = "\t" + op;
+  for (size_t a = 0; a < args.size(); a++)
+    l.text += (a == 0 ? " " : ", ") + args[a];
+}
+
+static void rebuild(AsmLine &l, string op, string a, string b) {
+  vector<string> args;
+  args.push_back(a);
+  args.push_back(b);
+  rebuild(l, op, args);
+}
+
+//index of the first line after i that hasn't been deleted, lines.size() at the end
+static size_t next(size_t i) {
+  do {
+    i++;
+  } while (i < lines.size() && lines[i].deleted);
+  return i;
+}
+
+//next instruction after i when nothing but deleted lines are in between
+static size_t adjacent(size_t i) {
+  size_t j = next(i);
+  if (j >= lines.size() || lines[j].op.empty())
+    return lines.size();
+  return j;
+}
+
+// labels already walked through by the current deadAfter
+static thread_local vector<size_t> visited;
+
+//true if the register is written before anything after line i reads it,
+//following jumps on every path until steps runs out
+static bool deadFrom(int reg, size_t i, int &steps) {
+  size_t j = i;
+  while (steps-- > 0) {
+    j = next(j);
+    if (j >= lines.size())
+      return false;
+    const AsmLine &l = lines[j];
+    if (!l.label.empty()) {
+      // a path that comes back around is checked where it was first seen
+      if (find(visited.begin(), visited.end(), j) != visited.end())
+        return true;
+      visited.push_back(j);
+      continue;
+    }
+    if (l.op == "jmp" || isConditionalJump(l.op)) {
+      if (l.args.size() != 1)
+        return false;
+      map<string, size_t>::const_iterator target = labelLine.find(l.args[0]);
+      if (target == labelLine.end())
+        return false;
+      if (l.op == "jmp") {
+        j = target->second;
+        continue;
+      }
+      if (!deadFrom(reg, target->second, steps))
+        return false;
+      continue;
+    }
+    if (l.op == "ret")  // read_integer returns in rax
+      return !(bit(reg) & (bit(RAX) | bit(RBX) | bit(RSP) | bit(RBP) |
+                           bit(R12) | bit(R13) | bit(R14) | bit(R15)));
+    if (!isKnown(l))
+      return false;
+    if (reads(l) & bit(reg))
+      return false;
+    if (writes(l) & bit(reg))
+      return true;
+  }
+  return false;
+}
+
+static bool deadAfter(int reg, size_t i) {
+  int steps = LOOK_AHEAD;
+  visited.clear();
+  return deadFrom(reg, i, steps);
+}
+
+//true if nothing after line i looks at the flags before they are set again
+static bool flagsDeadAfter(size_t i) {
+  size_t j = i;
+  for (int steps = 0; steps < LOOK_AHEAD; steps++) {
+    j = next(j);
+    if (j >= lines.size())
+      return false;
+    const AsmLine &l = lines[j];
+    if (!l.label.empty())
+      continue;
+    if (l.op == "jmp" && l.args.size() == 1) {
+      map<string, size_t>::const_iterator target = labelLine.find(l.args[0]);
+      if (target == labelLine.end())
+        return false;
+      j = target->second;
+      continue;
+    }
+    if (readsFlags(l.op))
+      return false;
+    if (writesFlags(l.op) || l.op == "call" || l.op == "ret")
+      return true;
+    if (!isKnown(l))
+      return false;
+  }
+  return false;
+}
+
+/////////////////////////////////////////////////////
+// the rules, each tries to rewrite starting at line i
+/////////////////////////////////////////////////////
+
+static bool isMove(const AsmLine &l) {
+  return l.op == "mov" && l.args.size() == 2;
+}
+
+//mov r, r does nothing for 64 bit registers
+static bool selfMove(size_t i) {
+  AsmLine &l = lines[i];
+  if (!isMove(l) || l.args[0] != l.args[1] || !isRegister64(l.args[0]))
+    return false;
+  l.deleted = true;
+  return true;
+}
+
+//a jump, taken or not, to the label right after it
+static bool jumpToNext(size_t i) {
+  AsmLine &l = lines[i];
+  if ((l.op != "jmp" && !isConditionalJump(l.op)) || l.args.size() != 1)
+    return false;
+  for (size_t j = next(i); j < lines.size() && !lines[j].label.empty(); j = next(j)) {
+    if (lines[j].label == l.args[0]) {
+      l.deleted = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+//push a then pop b is a move
+static bool pushPop(size_t i) {
+  AsmLine &push = lines[i];
+  if (push.op != "push" || push.args.size() != 1)
+    return false;
+  size_t j = adjacent(i);
+  if (j >= lines.size() || lines[j].op != "pop" || lines[j].args.size() != 1)
+    return false;
+  string a = push.args[0];
+  string b = lines[j].args[0];
+  if (isMemory(a) && isMemory(b))
+    return false;
+  push.deleted = true;
+  if (a == b)
+    lines[j].deleted = true;
+  else
+    rebuild(lines[j], "mov", b, a);
+  return true;
+}
+
+//mov a, b then mov b, a, the second copy changes nothing
+static bool moveBack(size_t i) {
+  const AsmLine &first = lines[i];
+  if (!isMove(first))
+    return false;
+  size_t j = adjacent(i);
+  if (j >= lines.size() || !isMove(lines[j]))
+    return false;
+  const AsmLine &second = lines[j];
+  if (second.args[0] != first.args[1] || second.args[1] != first.args[0])
+    return false;
+  if (registersIn(first.args[1]) & registersIn(first.args[0]))
+    return false;  // the first move changed the address of the second
+  lines[j].deleted = true;
+  return true;
+}
+
+//ops that take a memory or immediate source in place of a register
+static bool takesSource(const string &op) {
+  return op == "mov" || op == "add" || op == "sub" || op == "and" ||
+         op == "or" || op == "xor" || op == "cmp" || op == "test" || op == "imul";
+}
+
+//mov r, x then an instruction reading r, which is dead after it, can
+//read x directly
+static bool forwardCopy(size_t i) {
+  const AsmLine &copy = lines[i];
+  if (!isMove(copy) || !isRegister64(copy.args[0]))
+    return false;
+  int reg = registerOf(copy.args[0]);
+  const string &x = copy.args[1];
+  size_t j = adjacent(i);
+  if (j >= lines.size())
+    return false;
+  AsmLine &use = lines[j];
+  if (!isKnown(use) || use.op == "call" || use.op == "syscall" || use.op == "cqo" ||
+      use.op == "idiv" || (writes(use) & bit(reg)) || !(reads(use) & bit(reg)))
+    return false;
+  // test r, r reads the copy twice
+  if (use.op == "test" && use.args.size() == 2 && use.args[0] == use.args[1] &&
+      registerOf(use.args[0]) == reg && isRegister64(use.args[0]) && isRegister64(x)) {
+    if (!deadAfter(reg, j))
+      return false;
+    rebuild(use, "test", x, x);
+    lines[i].deleted = true;
+    return true;
+  }
+  // find the one operand that names the register
+  int at = -1;
+  for (size_t a = 0; a < use.args.size(); a++) {
+    if (!(registersIn(use.args[a]) & bit(reg)))
+      continue;
+    if (at >= 0)
+      return false;
+    at = a;
+  }
+  if (at < 0)
+    return false;
+  string replacement;
+  int size;
+  bool whole = registerOf(use.args[at], size) == reg;
+  bool high = use.args[at].size() == 2 && use.args[at][1] == 'h';  // ah to dh
+  int64_t value;
+  if (isRegister64(x) && whole && !high) {
+    replacement = registerNames[size][registerOf(x)];
+  } else if (isImmediate(x, value) && whole && size == SIZE_64 &&
+             value >= INT32_MIN && value <= INT32_MAX &&
+             ((at == 1 && takesSource(use.op) && use.op != "test" && use.args.size() == 2) ||
+              (use.op == "push" && use.args.size() == 1))) {
+    replacement = x;
+  } else if (isMemory(x) && whole && size == SIZE_64 &&
+             (takesSource(use.op) || use.op == "push")) {
+    for (size_t a = 0; a < use.args.size(); a++)
+      if ((int)a != at && isMemory(use.args[a]))
+        return false;
+    replacement = x;
+  } else {
+    return false;
+  }
+  if (!deadAfter(reg, j))
+    return false;
+  vector<string> args = use.args;
+  args[at] = replacement;
+  rebuild(use, use.op, args);
+  lines[i].deleted = true;
+  return true;
+}
+
+//a move into a register nothing reads before it is written again
+static bool deadMove(size_t i) {
+  const AsmLine &l = lines[i];
+  if (!isMove(l) || isPartial(l.args[0]) || !isRegister(l.args[0]) || registerOf(l.args[0]) == RSP)
+    return false;
+  if (!deadAfter(registerOf(l.args[0]), i))
+    return false;
+  lines[i].deleted = true;
+  return true;
+}
+
+//add or subtract 0, multiply by 1
+static bool identity(size_t i) {
+  const AsmLine &l = lines[i];
+  if (l.args.size() != 2)
+    return false;
+  bool none = ((l.op == "add" || l.op == "sub") && l.args[1] == "0") ||
+              (l.op == "imul" && l.args[1] == "1");
+  if (!none || !flagsDeadAfter(i))
+    return false;
+  lines[i].deleted = true;
+  return true;
+}
+
+//cmp r, 0 sets the same flags as the shorter test r, r
+static bool compareZero(size_t i) {
+  AsmLine &l = lines[i];
+  if (l.op != "cmp" || l.args.size() != 2 || l.args[1] != "0" || !isRegister(l.args[0]))
+    return false;
+  rebuild(l, "test", l.args[0], l.args[0]);
+  return true;
+}
+
+//mov r, 0 is longer than xor, which clears the upper half as well
+static bool zeroRegister(size_t i) {
+  AsmLine &l = lines[i];
+  if (!isMove(l) || !isRegister64(l.args[0]) || l.args[1] != "0" || !flagsDeadAfter(i))
+    return false;
+  string low = registerNames[SIZE_32][registerOf(l.args[0])];
+  rebuild(l, "xor", low, low);
+  return true;
+}
+
+//a 64 bit move of a small positive constant only needs the 32 bit form
+static bool shortConstant(size_t i) {
+  AsmLine &l = lines[i];
+  int64_t value;
+  if (!isMove(l) || !isRegister64(l.args[0]) || !isImmediate(l.args[1], value) ||
+      value <= 0 || value > INT32_MAX)
+    return false;
+  rebuild(l, "mov", registerNames[SIZE_32][registerOf(l.args[0])], l.args[1]);
+  return true;
+}
+
+const int TARGET_LINUX   = 1;
+const int TARGET_WINDOWS = 2;
+const int TARGET_ALL     = TARGET_LINUX | TARGET_WINDOWS;
+
+struct PeepholeRule {
+  const char *name;
+  int targets;
+  bool (*apply)(size_t i);
+  bool enabled;
+};
+
+// tried in order at every line, earlier rules see the longer forms
+static PeepholeRule rules[] = {
+  {"self-move",      TARGET_ALL,     selfMove,      true},
+  {"jump-to-next",   TARGET_ALL,     jumpToNext,    true},
+  {"push-pop",       TARGET_ALL,     pushPop,       true},
+  {"move-back",      TARGET_ALL,     moveBack,      true},
+  {"forward-copy",   TARGET_ALL,     forwardCopy,   true},
+  {"dead-move",      TARGET_ALL,     deadMove,      true},
+  {"identity",       TARGET_ALL,     identity,      true},
+  {"compare-zero",   TARGET_ALL,     compareZero,   true},
+  {"zero-register",  TARGET_ALL,     zeroRegister,  true},
+  {"short-constant", TARGET_ALL,     shortConstant, true}
+};
+static const int RULE_COUNT = sizeof(rules) / sizeof(rules[0]);
+
+// times each rule fired, summed over every compilation of a batch
+static atomic<uint64_t> ruleFired[RULE_COUNT];
+
+static int currentTarget() {
+  return CURRENT_OS == OS_WINDOWS ? TARGET_WINDOWS : TARGET_LINUX;
+}
+
+//one sweep of every rule over the lines, false if none fired
+static bool pass() {
+  labelLine.clear();
+  for (size_t i = 0; i < lines.size(); i++)
+    if (!lines[i].label.empty())
+      labelLine[lines[i].label] = i;
+  bool fired = false;
+  int target = currentTarget();
+  for (size_t i = 0; i < lines.size(); i++) {
+    for (int r = 0; r < RULE_COUNT; r++) {
+      if (lines[i].deleted || lines[i].op.empty())
+        break;
+      if (!rules[r].enabled || !(rules[r].targets & target))
+        continue;
+      if (rules[r].apply(i)) {
+        ruleFired[r]++;
+        fired = true;
+      }
+    }
+  }
+  vector<AsmLine> kept;
+  kept.reserve(lines.size());
+  for (size_t i = 0; i < lines.size(); i++)
+    if (!lines[i].deleted)
+      kept.push_back(move(lines[i]));
+  lines.swap(kept);
+  return fired;
+}
+
+void queueLine(string line) {
+  if (!peepholeEnabled && !METRICS) {
+    // no rule will look at it and no instructions are counted, keep the
+    // text only
+    lines.push_back(AsmLine());
+    lines.back().text.swap(line);
+    lines.back().deleted = false;
+    return;
+  }
+  lines.push_back(parseLine(move(line)));
+}
+
+void flushLines() {
+  if (peepholeEnabled) {
+    TRACE(TRACE_LEVEL_EMIT, "flushLines() %d lines", (int64_t)lines.size());
+    for (int p = 0; p < MAX_PASSES && pass(); p++)
+      ;
+  }
+  uint64_t instructions = 0;
+  for (size_t i = 0; i < lines.size(); i++) {
+    writeLine(lines[i].text);
+    instructions += !lines[i].op.empty();
+  }
+  metricsCount(COUNT_INSTRUCTIONS, instructions);
+  lines.clear();
+}
+
+bool disableRule(string name) {
+  for (int r = 0; r < RULE_COUNT; r++) {
+    if (name == rules[r].name) {
+      rules[r].enabled = false;
+      return true;
+    }
+  }
+  return false;
+}
+
+void peepholeReport() {
+  printf("::Peephole rules::::::::::::::::::::::\n");
+  uint64_t total = 0;
+  for (int r = 0; r < RULE_COUNT; r++) {
+    const char *state = !rules[r].enabled ? "off"
+                      : !(rules[r].targets & currentTarget()) ? "n/a" : "";
+    printf("%-16s %10llu %s\n", rules[r].name, (unsigned long long)ruleFired[r].load(), state);
+    total += ruleFired[r];
+  }
+  printf("%-16s %10llu\n", "total", (unsigned long long)total);
+  printf("::::::::::::::::::::::::::::::::::::::\n");
+}
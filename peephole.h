@@ -0,0 +1,30 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <string>
+
+// peephole optimization of the emitted assembly
+//
+// lines the emitters write are queued here and go out to the .asm file a
+// function at a time. Before they do, a table of rewrite rules is run
+// over them until none applies. Each rule looks at a window of a few
+// instructions, some of them also look ahead to see whether a register
+// or the flags are still needed. Rules can be limited to the linux or the
+// windows output and are counted every time they fire.
+
+//false to write lines out exactly as they were emitted, -O0
+extern thread_local bool peepholeEnabled;
+
+//queue one line of output, a label or a tab indented instruction
+void queueLine(std::string line);
+
+//optimize the queued lines and write them out
+void flushLines();
+
+//turn a rule off by name, false if there is no such rule
+bool disableRule(std::string name);
+
+//print how often each rule fired
+void peepholeReport();
+
+#endif // PEEPHOLE_H
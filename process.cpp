@@ -0,0 +1,169 @@
+#include "process.h"
+#include "trace.h"
+
+#include <chrono>
+#include <stdint.h>
+
+#ifdef __linux
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char **environ;
+#else
+#include <mutex>
+#include <windows.h>
+#endif
+
+using namespace std;
+
+static const size_t READ_SIZE = 65536;
+
+#ifdef __linux
+ProcessResult runProcess(const vector<string> &args, bool capture) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  ProcessResult result;
+  result.status = -1;
+  result.seconds = 0;
+  result.cpuSeconds = 0;
+  vector<char *> argv;
+  for (size_t i = 0; i < args.size(); i++)
+    argv.push_back(const_cast<char *>(args[i].c_str()));
+  argv.push_back(NULL);
+
+  // close on exec, so a child started by another thread doesn't keep the
+  // pipe open, dup2 clears it again for this child's standard output
+  int fds[2];
+  if (capture && pipe2(fds, O_CLOEXEC) != 0)
+    return result;
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (capture) {
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 2);
+  }
+  pid_t pid;
+  int error = posix_spawnp(&pid, argv[0], &actions, NULL, &argv[0], environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (capture)
+    close(fds[1]);
+  if (error != 0) {
+    if (capture)
+      close(fds[0]);
+    return result;
+  }
+
+  if (capture) {
+    vector<char> buffer(READ_SIZE);
+    for (;;) {
+      ssize_t n = read(fds[0], &buffer[0], READ_SIZE);
+      if (n > 0)
+        result.output.append(&buffer[0], n);
+      else if (n == 0 || errno != EINTR)
+        break;
+    }
+    close(fds[0]);
+  }
+  int status = 0;
+  struct rusage usage;
+  while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR)
+    ;
+  result.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  result.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                    + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  TRACE(TRACE_LEVEL_PHASE, "runProcess(%s) status %d", args[0], (int64_t)result.status);
+  return result;
+}
+
+#else
+//one argument of a command line, quoted the way the C runtime splits it
+static string quoteArgument(const string &arg) {
+  if (!arg.empty() && arg.find_first_of(" \t\"") == string::npos)
+    return arg;
+  string quoted = "\"";
+  size_t backslashes = 0;
+  for (size_t i = 0; i < arg.size(); i++) {
+    if (arg[i] == '\\') {
+      backslashes++;
+      continue;
+    }
+    // backslashes are only special in front of a quote
+    quoted.append(arg[i] == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+    backslashes = 0;
+    quoted += arg[i];
+  }
+  quoted.append(backslashes * 2, '\\');
+  return quoted + "\"";
+}
+
+// held from making a pipe until the parent's copy of its write end is
+// closed. Children inherit every inheritable handle, so a child started by
+// another thread in between would keep the pipe open and the read below
+// wouldn't end until that child did
+static mutex spawnLock;
+
+ProcessResult runProcess(const vector<string> &args, bool capture) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  ProcessResult result;
+  result.status = -1;
+  result.seconds = 0;
+  result.cpuSeconds = 0;
+  string commandLine;
+  for (size_t i = 0; i < args.size(); i++)
+    commandLine += (i > 0 ? " " : "") + quoteArgument(args[i]);
+
+  SECURITY_ATTRIBUTES inherit = {sizeof(SECURITY_ATTRIBUTES), NULL, TRUE};
+  HANDLE readEnd = NULL, writeEnd = NULL;
+  STARTUPINFOA startup;
+  ZeroMemory(&startup, sizeof(startup));
+  startup.cb = sizeof(startup);
+  PROCESS_INFORMATION process;
+  BOOL started;
+  {
+    lock_guard<mutex> lock(spawnLock);
+    if (capture) {
+      if (!CreatePipe(&readEnd, &writeEnd, &inherit, 0))
+        return result;
+      SetHandleInformation(readEnd, HANDLE_FLAG_INHERIT, 0);
+      startup.dwFlags = STARTF_USESTDHANDLES;
+      startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+      startup.hStdOutput = writeEnd;
+      startup.hStdError = writeEnd;
+    }
+    started = CreateProcessA(NULL, &commandLine[0], NULL, NULL, TRUE, 0, NULL, NULL, &startup, &process);
+    if (capture)
+      CloseHandle(writeEnd);
+  }
+  if (!started) {
+    if (capture)
+      CloseHandle(readEnd);
+    return result;
+  }
+
+  if (capture) {
+    vector<char> buffer(READ_SIZE);
+    DWORD n;
+    while (ReadFile(readEnd, &buffer[0], READ_SIZE, &n, NULL) && n > 0)
+      result.output.append(&buffer[0], n);
+    CloseHandle(readEnd);
+  }
+  WaitForSingleObject(process.hProcess, INFINITE);
+  DWORD code = 0;
+  GetExitCodeProcess(process.hProcess, &code);
+  FILETIME created, exited, kernel, user;
+  if (GetProcessTimes(process.hProcess, &created, &exited, &kernel, &user)) {
+    uint64_t ticks = ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime)
+                   + ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+    result.cpuSeconds = ticks / 1e7;
+  }
+  CloseHandle(process.hThread);
+  CloseHandle(process.hProcess);
+  result.status = (int)code;
+  result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  TRACE(TRACE_LEVEL_PHASE, "runProcess(%s) status %d", args[0], (int64_t)result.status);
+  return result;
+}
+#endif
@@ -0,0 +1,24 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <string>
+#include <vector>
+
+// running nasm, the linker and the compiled program
+//
+// a process is started straight from its argument list, no shell is in
+// between, and the compiler waits for it to end. Its output is read from a
+// pipe in large blocks, or it writes to the compiler's own standard output
+// when it isn't captured. Standard input is always shared.
+
+struct ProcessResult {
+  int status;          // exit code, 128 + the signal if killed, -1 if it didn't start
+  std::string output;  // standard output and error, when captured
+  double seconds;      // wall clock time from start to end
+  double cpuSeconds;   // user and system time of the process
+};
+
+//run args[0] with args, looking it up in PATH when it has no directory
+ProcessResult runProcess(const std::vector<std::string> &args, bool capture);
+
+#endif // PROCESS_H
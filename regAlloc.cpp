@@ -0,0 +1,219 @@
+#include "regAlloc.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <limits.h>
+
+using namespace std;
+
+// rax and rbx are never handed out, codegen needs them for results, moves
+// between memory operands and wide constants, rdx is taken by cqo/idiv.
+// The first CALLER_SAVED_COUNT are clobbered by calls, reads and writes
+static const char *registers[] = {
+  "rcx", "rsi", "rdi", "r8", "r9", "r10", "r11",
+  "r12", "r13", "r14", "r15"
+};
+static const int REGISTER_COUNT = sizeof(registers) / sizeof(registers[0]);
+static const int CALLER_SAVED_COUNT = 7;
+
+struct Interval {
+  int value;
+  int start;
+  int end;
+  bool crossesCall;   // live across a call, read or write
+};
+
+static thread_local const IrFunction *fn;
+static thread_local vector<int> blockStart;      // position of the phis of a block
+static thread_local vector<int> blockEnd;        // position phi arguments are read at
+static thread_local vector<int> defBlock;        // indexed by value
+static thread_local vector<int> intervalStart;   // indexed by value
+static thread_local vector<int> intervalEnd;
+static thread_local vector<int> clobbers;        // positions of calls, reads and writes
+static thread_local vector<vector<int> > partners;  // values joined by a phi
+
+bool isCalleeSaved(string reg) {
+  for (int r = CALLER_SAVED_COUNT; r < REGISTER_COUNT; r++)
+    if (reg == registers[r])
+      return true;
+  return false;
+}
+
+static void extend(int v, int pos) {
+  intervalStart[v] = min(intervalStart[v], pos);
+  intervalEnd[v] = max(intervalEnd[v], pos);
+}
+
+//number the phis and instructions of each block in order, an instruction
+//at p reads its operands at p and defines its value at p+1
+static void numberInstructions(const vector<int> &order) {
+  int blockCount = fn->blocks.size();
+  blockStart.assign(blockCount, -1);
+  blockEnd.assign(blockCount, -1);
+  defBlock.assign(fn->valueCount, -1);
+  intervalStart.assign(fn->valueCount, INT_MAX);
+  intervalEnd.assign(fn->valueCount, -1);
+  clobbers.clear();
+  int pos = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    int b = order[i];
+    const IrBlock &block = fn->blocks[b];
+    blockStart[b] = pos;
+    for (size_t p = 0; p < block.phis.size(); p++) {
+      defBlock[block.phis[p].dst] = b;
+      extend(block.phis[p].dst, pos);
+    }
+    for (size_t k = 0; k < block.insts.size(); k++) {
+      pos += 2;
+      const IrInst &inst = block.insts[k];
+      if (inst.op == IR_CALL || inst.op == IR_READ || inst.op == IR_WRITE)
+        clobbers.push_back(pos);
+      if (inst.dst != NO_VALUE) {
+        defBlock[inst.dst] = b;
+        extend(inst.dst, pos + 1);
+      }
+    }
+    blockEnd[b] = pos;
+    pos += 2;
+  }
+}
+
+//stretch the interval of v over every block it is live into from block b
+static void liveIn(int v, int b, vector<int> &mark) {
+  vector<int> work(1, b);
+  while (!work.empty()) {
+    int w = work.back();
+    work.pop_back();
+    if (mark[w] == v)
+      continue;
+    mark[w] = v;
+    extend(v, blockStart[w]);
+    const vector<int> &preds = fn->blocks[w].preds;
+    for (size_t p = 0; p < preds.size(); p++) {
+      extend(v, blockEnd[preds[p]]);
+      if (defBlock[v] != preds[p])
+        work.push_back(preds[p]);
+    }
+  }
+}
+
+//build the interval of every value from its uses
+static void buildIntervals() {
+  // uses of each value as block and position, so one value is done at a time
+  vector<vector<pair<int,int> > > uses(fn->valueCount);
+  partners.assign(fn->valueCount, vector<int>());
+  for (size_t b = 0; b < fn->blocks.size(); b++) {
+    const IrBlock &block = fn->blocks[b];
+    if (blockStart[b] < 0)
+      continue; // unreachable
+    int pos = blockStart[b];
+    for (size_t k = 0; k < block.insts.size(); k++) {
+      pos += 2;
+      const IrInst &inst = block.insts[k];
+      int n = operandCount(inst);
+      if (n > 0)
+        uses[inst.a].push_back(make_pair((int)b, pos));
+      if (n > 1)
+        uses[inst.b].push_back(make_pair((int)b, pos));
+    }
+    for (size_t p = 0; p < block.phis.size(); p++) {
+      const IrPhi &phi = block.phis[p];
+      for (size_t a = 0; a < phi.args.size(); a++) {
+        int pred = block.preds[a];
+        uses[phi.args[a]].push_back(make_pair(pred, blockEnd[pred]));
+        partners[phi.dst].push_back(phi.args[a]);
+        partners[phi.args[a]].push_back(phi.dst);
+      }
+    }
+  }
+  vector<int> mark(fn->blocks.size(), -1);
+  for (int v = 0; v < fn->valueCount; v++) {
+    for (size_t u = 0; u < uses[v].size(); u++) {
+      int b = uses[v][u].first;
+      extend(v, uses[v][u].second);
+      if (defBlock[v] != b)
+        liveIn(v, b, mark);
+    }
+  }
+}
+
+//true if a call, read or write happens while v is live
+static bool crossesCall(int v) {
+  vector<int>::const_iterator c = upper_bound(clobbers.begin(), clobbers.end(), intervalStart[v]);
+  return c != clobbers.end() && *c < intervalEnd[v];
+}
+
+static bool byStart(const Interval &a, const Interval &b) {
+  return a.start < b.start || (a.start == b.start && a.value < b.value);
+}
+
+vector<string> allocateRegisters(const IrFunction &f, const vector<int> &order) {
+  fn = &f;
+  numberInstructions(order);
+  buildIntervals();
+
+  vector<char> isConstant(f.valueCount, false);
+  for (size_t b = 0; b < f.blocks.size(); b++)
+    for (size_t k = 0; k < f.blocks[b].insts.size(); k++)
+      if (f.blocks[b].insts[k].op == IR_CONST)
+        isConstant[f.blocks[b].insts[k].dst] = true;
+
+  vector<Interval> intervals;
+  for (int v = 0; v < f.valueCount; v++) {
+    if (isConstant[v] || defBlock[v] < 0)
+      continue;
+    Interval i;
+    i.value = v;
+    i.start = intervalStart[v];
+    i.end = intervalEnd[v];
+    i.crossesCall = crossesCall(v);
+    intervals.push_back(i);
+  }
+  sort(intervals.begin(), intervals.end(), byStart);
+
+  vector<int> assigned(f.valueCount, -1);  // register index per value
+  vector<int> holder(REGISTER_COUNT, -1);  // interval holding each register
+  int spills = 0;
+  for (size_t i = 0; i < intervals.size(); i++) {
+    const Interval &current = intervals[i];
+    // expire intervals that ended before this one starts
+    for (int r = 0; r < REGISTER_COUNT; r++)
+      if (holder[r] >= 0 && intervals[holder[r]].end < current.start)
+        holder[r] = -1;
+
+    int first = current.crossesCall ? CALLER_SAVED_COUNT : 0;
+    int reg = -1;
+    // a register shared with a phi partner saves a copy on the edge
+    const vector<int> &p = partners[current.value];
+    for (size_t k = 0; k < p.size() && reg < 0; k++) {
+      int r = assigned[p[k]];
+      if (r >= first && holder[r] < 0)
+        reg = r;
+    }
+    for (int r = first; r < REGISTER_COUNT && reg < 0; r++)
+      if (holder[r] < 0)
+        reg = r;
+    if (reg < 0) {
+      // spill whichever of current and the active intervals ends last
+      int victim = first;
+      for (int r = first; r < REGISTER_COUNT; r++)
+        if (intervals[holder[r]].end > intervals[holder[victim]].end)
+          victim = r;
+      spills++;
+      if (intervals[holder[victim]].end <= current.end)
+        continue;
+      assigned[intervals[holder[victim]].value] = -1;
+      reg = victim;
+    }
+    holder[reg] = i;
+    assigned[current.value] = reg;
+  }
+  TRACE(TRACE_LEVEL_EMIT, "allocateRegisters() %d intervals, %d spilled",
+        (int64_t)intervals.size(), (int64_t)spills);
+
+  vector<string> result(f.valueCount);
+  for (int v = 0; v < f.valueCount; v++)
+    if (assigned[v] >= 0)
+      result[v] = registers[assigned[v]];
+  return result;
+}
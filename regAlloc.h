@@ -0,0 +1,25 @@
+#ifndef REG_ALLOC_H
+#define REG_ALLOC_H
+
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+// linear scan register allocation over the values of an IrFunction
+//
+// every value gets one live interval from its definition to its last use,
+// stretched over the blocks it is live through, in the block order the
+// function is written in. Intervals are walked by start and handed x86-64
+// registers, when none is free the interval ending last is spilled.
+// Values live across a call, read or write only get registers the callee
+// preserves, subroutines save the ones they use in their prolog.
+
+//register given to each value of f, empty for values left in memory and
+//for constants, which are used in place
+std::vector<std::string> allocateRegisters(const IrFunction &f, const std::vector<int> &order);
+
+//true for registers a subroutine must save before using
+bool isCalleeSaved(std::string reg);
+
+#endif // REG_ALLOC_H
@@ -0,0 +1,118 @@
+// 64 bit file offsets on 32 bit hosts, must come before any system header
+#define _FILE_OFFSET_BITS 64
+
+#include "sourceReader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+thread_local const char *sourceCursor = NULL;
+thread_local const char *sourceEnd = NULL;
+
+static thread_local char *readBuffer = NULL;   // set when the source was read into the heap
+static thread_local void *mappedBuffer = NULL; // set when the source is memory mapped
+static thread_local uint64_t mappedLength = 0;
+
+// size of the blocks used when the file can't be mapped
+static const size_t READ_BLOCK_SIZE = 1 << 20;
+
+static void setBuffer(const char *begin, uint64_t length) {
+  sourceCursor = begin;
+  sourceEnd = begin + length;
+}
+
+#ifdef __linux
+//map the whole file read only, false if it can't be mapped
+static bool mapFile(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return false;
+  uint64_t length = (uint64_t)st.st_size;
+  if (length != (size_t)length)
+    return false; // larger than the address space
+  void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED)
+    return false;
+  madvise(p, length, MADV_SEQUENTIAL);
+  mappedBuffer = p;
+  mappedLength = length;
+  setBuffer((const char *)p, length);
+  return true;
+}
+#endif
+
+//read the whole file into the heap in large blocks
+static bool readFile(FILE *f) {
+  size_t capacity = READ_BLOCK_SIZE;
+  size_t length = 0;
+  char *buffer = (char *)malloc(capacity);
+  if (buffer == NULL)
+    return false;
+  for (;;) {
+    if (capacity - length < READ_BLOCK_SIZE) {
+      char *grown = (char *)realloc(buffer, capacity * 2);
+      if (grown == NULL) {
+        free(buffer);
+        return false;
+      }
+      buffer = grown;
+      capacity *= 2;
+    }
+    size_t n = fread(buffer + length, 1, READ_BLOCK_SIZE, f);
+    length += n;
+    if (n < READ_BLOCK_SIZE)
+      break;
+  }
+  if (ferror(f)) {
+    free(buffer);
+    return false;
+  }
+  readBuffer = buffer;
+  setBuffer(buffer, length);
+  return true;
+}
+
+bool sourceOpen(std::string fileName) {
+  sourceClose();
+#ifdef __linux
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  bool mapped = mapFile(fd);
+  close(fd);
+  if (mapped)
+    return true;
+#endif
+  // pipes, empty files and hosts without mmap
+  FILE *f = fopen(fileName.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  bool ok = readFile(f);
+  fclose(f);
+  return ok;
+}
+
+void sourceOpenBuffer(const char *text, uint64_t length) {
+  sourceClose();
+  setBuffer(text, length);
+}
+
+void sourceClose() {
+#ifdef __linux
+  if (mappedBuffer != NULL)
+    munmap(mappedBuffer, mappedLength);
+#endif
+  free(readBuffer);
+  mappedBuffer = NULL;
+  mappedLength = 0;
+  readBuffer = NULL;
+  sourceCursor = NULL;
+  sourceEnd = NULL;
+}
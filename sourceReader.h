@@ -0,0 +1,33 @@
+#ifndef SOURCE_READER_H
+#define SOURCE_READER_H
+
+#include <string>
+#include <stdint.h>
+
+//cursor into the source buffer, points at the current character
+extern thread_local const char *sourceCursor;
+
+//one past the last character of the source buffer
+extern thread_local const char *sourceEnd;
+
+//open a source file, memory mapping it when possible
+bool sourceOpen(std::string fileName);
+
+//use source text already in memory, the caller keeps it alive until
+//sourceClose
+void sourceOpenBuffer(const char *text, uint64_t length);
+
+//release the source buffer
+void sourceClose();
+
+//true once the cursor has moved past the last character
+inline bool sourceEof() {
+  return sourceCursor >= sourceEnd;
+}
+
+//character under the cursor, '\0' past the end of the source
+inline char sourceLook() {
+  return sourceCursor < sourceEnd ? *sourceCursor : '\0';
+}
+
+#endif // SOURCE_READER_H
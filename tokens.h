@@ -5,9 +5,9 @@
 
 //keywords and token types
 
-// constants to determine OS
-int OS_LINUX      = 0;
-int OS_WINDOWS    = 1;
+// constants to determine OS, defined in main.cpp
+extern int OS_LINUX;
+extern int OS_WINDOWS;
 
 const int SYM_DIGIT     = -1;
 const int SYM_IDENT     = 0; // must be 0 to prevent infinite loops
@@ -24,6 +24,7 @@ const int SYM_READ      = 9;
 const int SYM_WRITE     = 10;
 const int SYM_SUB       = 11;
 const int SYM_END_SUB   = 12;
+const int SYM_CONST     = 13;
 
 //const int VAR_INT       = 0; // integers
 const int VAR_PARAM     = 10;// sub parameters
@@ -47,21 +48,22 @@ const int OP_REL_N      = 1012; // !
 const int OP_REL_A      = 1013; // &
 const int OP_COMMA      = 1014; // ,
 const int OP_SEMICOLON  = 1015; // ;
+const int OP_REL_LE     = 1016; // <= relations made of two tokens
+const int OP_REL_GE     = 1017; // >=
 
+const int TYPE_NONE     = -1;// not in the symbol table
 const int TYPE_INT      = 0;
 const int TYPE_CHAR     = 1;
 const int TYPE_LONG     = 2;
 const int TYPE_STRING   = 3;
 const int TYPE_FLOAT    = 4;
+const int TYPE_CONST    = 5; // named constant, never has storage
 
 const int TYPE_SUB      = 11;
 
-
-const int KEYWORD_COUNT = 12;
-const int OPERATOR_COUNT = 16;
-std::string operatorList[] = {"|","~","+","-","*","/","=","#","<",">","(",")","!","&", ",",";"};
-std::string keywordList[] = {"if", "else", "endif", "while", "wend", "dim", "main", "endmain", "read", "write", "sub", "endsub"};
-std::string value;
-int token;
+// current token, defined in main.cpp
+extern thread_local std::string value;
+extern thread_local int token;
+extern thread_local int symbolId; // interned id of value when token is an identifier
 
 #endif // TOKENS_H
@@ -0,0 +1,108 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+extern thread_local uint64_t lineCount;
+
+int traceLevel = TRACE_LEVEL_NONE;
+
+// a fixed size binary record, nothing is formatted until the dump
+struct TraceEvent {
+  const char *format; // NULL for a slot that was never written
+  uint64_t line;
+  int64_t a;
+  int64_t b;
+  char text[32];
+};
+
+// ring buffer of the most recent events, older events are overwritten
+static const uint64_t TRACE_RING_SIZE = 1 << 16;
+static TraceEvent *traceRing = NULL;
+static std::atomic<uint64_t> traceHead(0);
+
+void traceStart(int level) {
+  if (traceRing == NULL) {
+    traceRing = (TraceEvent *)calloc(TRACE_RING_SIZE, sizeof(TraceEvent));
+    if (traceRing == NULL)
+      return;
+    atexit(traceDump);
+  }
+  traceLevel = level;
+}
+
+//claim the next slot, safe to call from several threads
+static TraceEvent *nextEvent(const char *format) {
+  uint64_t i = traceHead.fetch_add(1, std::memory_order_relaxed);
+  TraceEvent *e = &traceRing[i & (TRACE_RING_SIZE - 1)];
+  e->format = format;
+  e->line = lineCount;
+  return e;
+}
+
+void traceEvent(const char *format) {
+  nextEvent(format);
+}
+
+void traceEvent(const char *format, int64_t a, int64_t b) {
+  TraceEvent *e = nextEvent(format);
+  e->a = a;
+  e->b = b;
+}
+
+void traceEvent(const char *format, const std::string &text, int64_t a) {
+  TraceEvent *e = nextEvent(format);
+  e->a = a;
+  size_t n = text.copy(e->text, sizeof(e->text) - 1);
+  e->text[n] = '\0';
+}
+
+//expand one event, %d and %c take a then b, %s takes the text
+static void printEvent(const TraceEvent *e) {
+  const int64_t args[] = {e->a, e->b};
+  int arg = 0;
+  for (const char *p = e->format; *p != '\0'; p++) {
+    if (*p != '%' || p[1] == '\0') {
+      if (*p != '\n')
+        putchar(*p);
+      continue;
+    }
+    p++;
+    switch (*p) {
+    case 'd':
+      printf("%lld", (long long)args[arg++ & 1]);
+      break;
+    case 'c':
+      putchar((char)args[arg++ & 1]);
+      break;
+    case 's':
+      for (const char *t = e->text; *t != '\0'; t++)
+        if (*t != '\n')
+          putchar(*t);
+      break;
+    default:
+      putchar(*p);
+    }
+  }
+  printf(" in source file [line: %llu]\n", (unsigned long long)e->line);
+}
+
+void traceDump() {
+  if (traceRing == NULL)
+    return;
+  uint64_t head = traceHead.load();
+  uint64_t first = 0;
+  if (head > TRACE_RING_SIZE) {
+    first = head - TRACE_RING_SIZE;
+    printf("(%llu earlier trace events dropped)\n", (unsigned long long)first);
+  }
+  for (uint64_t i = first; i < head; i++) {
+    const TraceEvent *e = &traceRing[i & (TRACE_RING_SIZE - 1)];
+    if (e->format != NULL)
+      printEvent(e);
+  }
+  fflush(stdout);
+  traceHead = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <stdint.h>
+
+// trace levels, each one includes everything below it
+const int TRACE_LEVEL_NONE  = 0;
+const int TRACE_LEVEL_PHASE = 1; // compiler phases and toolchain calls
+const int TRACE_LEVEL_PARSE = 2; // parser productions
+const int TRACE_LEVEL_EMIT  = 3; // every emitted line
+const int TRACE_LEVEL_LEX   = 4; // every token
+
+// highest level compiled in, build with -DTRACE_MAX_LEVEL=0 to remove
+// every trace point from the binary
+#ifndef TRACE_MAX_LEVEL
+  #define TRACE_MAX_LEVEL TRACE_LEVEL_LEX
+#endif
+
+// level selected at run time, TRACE_LEVEL_NONE unless tracing was started
+extern int traceLevel;
+
+#define TRACE_ENABLED(level) ((level) <= TRACE_MAX_LEVEL && (level) <= traceLevel)
+
+// record a trace event, arguments are only evaluated when the level is on
+//   TRACE(level, format)          plain message
+//   TRACE(level, format, a[, b])  integers, formatted with %d or %c
+//   TRACE(level, format, text[, a]) string, copied and formatted with %s
+// formats must be string literals, they are only expanded when dumped
+#define TRACE(level, ...) \
+  do { if (TRACE_ENABLED(level)) traceEvent(__VA_ARGS__); } while (0)
+
+//turn tracing on at level, events are dumped when the compiler exits
+void traceStart(int level);
+
+//write every buffered event to stdout
+void traceDump();
+
+void traceEvent(const char *format);
+void traceEvent(const char *format, int64_t a, int64_t b = 0);
+void traceEvent(const char *format, const std::string &text, int64_t a = 0);
+
+#endif // TRACE_H